@@ -17,6 +17,15 @@ class Camera {
   static double cy_;
   static Mat33 K_;
   static Vec4 dist_coeffs_;
+  // Undistortion lookup table (CV_32FC2) storing the undistorted coordinates
+  // of each pixel. Empty if there's no distortion.
+  static cv::Mat undist_map_;
+
+  // Build undistortion lookup table from K_ and dist_coeffs_ for images of
+  // the size. Called once after camera parameters are set.
+  static void initUndistortMap(const cv::Size& img_size);
+
+  static inline bool isDistorted() { return !undist_map_.empty(); }
 
   // Empty constructor used only when setting camera parameters.
   Camera();
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <deque>
 #include <forward_list>
 #include <iostream>
 #include <iterator>
@@ -23,6 +24,7 @@
 // multi-threading related
 #include <atomic>              // std::atomic
 #include <condition_variable>  // std::condition_variable, notify_one.
+#include <future>              // std::future
 #include <mutex>               // std::mutex, std::lock_guard, std::unique_lock
 #include <thread>              // std::thread
 
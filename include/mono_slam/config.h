@@ -20,6 +20,44 @@ class Config {
 
   static int& min_n_feats() { return getInstance().min_n_feats_; }
 
+  // Number of threads used for matching, including the calling thread.
+  static int& n_matcher_threads() { return getInstance().n_matcher_threads_; }
+
+  // Number of threads used by the local mapper, including the mapping thread.
+  static int& n_mapper_threads() { return getInstance().n_mapper_threads_; }
+
+  // Retain the colour image of each frame for drawing. Otherwise, only the
+  // grayscale image is drawn.
+  static bool& retain_color_imgs() { return getInstance().retain_color_imgs_; }
+
+  // Number of images the dataset loads ahead of the tracker and number of
+  // threads decoding them.
+  static int& dataset_n_prefetch() {
+    return getInstance().dataset_n_prefetch_;
+  }
+  static int& dataset_n_decode_threads() {
+    return getInstance().dataset_n_decode_threads_;
+  }
+
+  // Number of frames preprocessed ahead of the frame being tracked. Set to 0
+  // to preprocess and track each frame sequentially.
+  static int& pipeline_depth() { return getInstance().pipeline_depth_; }
+
+  // Track frames not due to become keyframes by propagating the observations
+  // of last frame with pyramidal Lucas-Kanade optical flow. Features are then
+  // only extracted when a keyframe may be created or tracking quality drops.
+  static bool& use_klt_tracking() { return getInstance().use_klt_tracking_; }
+
+  // Optical flow search window size and number of pyramid levels.
+  static int& klt_win_size() { return getInstance().klt_win_size_; }
+  static int& klt_n_levels() { return getInstance().klt_n_levels_; }
+
+  // Minimum number of inliers of optical flow tracking below which features
+  // are extracted and the frame is tracked by matching descriptors.
+  static int& klt_min_n_inlier_matches() {
+    return getInstance().klt_min_n_inlier_matches_;
+  }
+
   static int& min_n_matches() { return getInstance().min_n_matches_; }
 
   static int& min_n_inlier_matches() {
@@ -71,6 +109,11 @@ class Config {
 
   static int& search_radius() { return getInstance().search_radius_; }
 
+  // Number of columns and rows of the grid each frame assigns its features
+  // into to accelerate searching features within a radius.
+  static int& grid_n_cols() { return getInstance().grid_n_cols_; }
+  static int& grid_n_rows() { return getInstance().grid_n_rows_; }
+
   // Searching factor of differene viewing direction.
   static double& search_view_dir_factor(const double cos_view_dir) {
     if (cos_view_dir > 0.998)  // When viewing direction less than 3.6 degree.
@@ -90,6 +133,23 @@ class Config {
   // Number of image pyramid levels.
   static int& scale_n_levels() { return getInstance().scale_n_levels_; }
 
+  // FAST thresholds used during feature extraction. The lower one is used in
+  // cells where nothing is detected with the initial one.
+  static int& fast_thresh_init() { return getInstance().fast_thresh_init_; }
+  static int& fast_thresh_min() { return getInstance().fast_thresh_min_; }
+
+  // Size in pixels of the cells each pyramid level is split into during
+  // feature extraction.
+  static int& extractor_cell_size() {
+    return getInstance().extractor_cell_size_;
+  }
+
+  // Number of threads used for feature extraction, including the tracking
+  // thread.
+  static int& n_extractor_threads() {
+    return getInstance().n_extractor_threads_;
+  }
+
   // Squared noise sigmas of each image pyramid level.
   static vector<double>& scale_level_sigma2() {
     return getInstance().scale_level_sigma2_;
@@ -130,6 +190,16 @@ class Config {
   // Global Configurations.
   int max_n_feats_;
   int min_n_feats_;
+  int n_matcher_threads_;
+  int n_mapper_threads_;
+  bool retain_color_imgs_;
+  int dataset_n_prefetch_;
+  int dataset_n_decode_threads_;
+  int pipeline_depth_;
+  bool use_klt_tracking_;
+  int klt_win_size_;
+  int klt_n_levels_;
+  int klt_min_n_inlier_matches_;
   int min_n_matches_;
   int min_n_inlier_matches_;
   int init_min_n_feats_;
@@ -144,11 +214,17 @@ class Config {
   int match_thresh_relax_;
   int match_thresh_strict_;
   int search_radius_;
+  int grid_n_cols_;
+  int grid_n_rows_;
   double search_view_dir_factor_low_;
   double search_view_dir_factor_high_;
   double scale_factor_;
   vector<double> scale_factors_;
   int scale_n_levels_;
+  int fast_thresh_init_;
+  int fast_thresh_min_;
+  int extractor_cell_size_;
+  int n_extractor_threads_;
   vector<double> scale_level_sigma2_;
   double dist_ratio_test_factor_;
   double redun_factor_;
@@ -0,0 +1,127 @@
+#ifndef MONO_SLAM_COVISIBILITY_GRAPH_H_
+#define MONO_SLAM_COVISIBILITY_GRAPH_H_
+
+#include "mono_slam/common_include.h"
+#include "mono_slam/frame.h"
+#include "mono_slam/map_point.h"
+
+namespace mono_slam {
+
+class Frame;
+class MapPoint;
+
+// Covisibility graph of keyframes where the weight of the edge linking two
+// keyframes is the number of map points they both observe, along with a
+// spanning tree linking each keyframe to the one it shares the most map points
+// with when inserted.
+//! Weights are kept up to date incrementally: inserting a keyframe counts its
+//! shared map points once, while adding or erasing an observation afterwards
+//! only bumps the weights of the keyframes observing the map point. Nothing
+//! cascades to the neighbours. Neighbours ranked by weight are sorted lazily
+//! as they're queried and shared with readers as immutable lists.
+//! Observers of map points are counted from the raw observations, regardless
+//! of outlier flags which may flip in between, such that every increment is
+//! matched by a decrement.
+class CovisibilityGraph {
+ public:
+  using Ptr = uptr<CovisibilityGraph>;
+
+  // Covisible keyframes ranked by decreasing weight, i.e. a range over the
+  // first n keyframes of a sorted list shared with the graph.
+  class View {
+   public:
+    using const_iterator = vector<Frame::Ptr>::const_iterator;
+
+    View() = default;
+    View(sptr<const vector<Frame::Ptr>> kfs, const int n)
+        : kfs_(std::move(kfs)),
+          n_(std::min(n, static_cast<int>(kfs_->size()))) {}
+
+    inline const_iterator begin() const {
+      return kfs_ ? kfs_->cbegin() : const_iterator();
+    }
+    inline const_iterator end() const { return begin() + n_; }
+    inline const_iterator cbegin() const { return begin(); }
+    inline const_iterator cend() const { return end(); }
+    inline const Frame::Ptr& operator[](const int i) const {
+      return (*kfs_)[i];
+    }
+    inline int size() const { return n_; }
+    inline bool empty() const { return n_ == 0; }
+
+   private:
+    sptr<const vector<Frame::Ptr>> kfs_{nullptr};
+    int n_ = 0;
+  };
+
+  // Insert the keyframe and link it to the keyframes sharing map points with
+  // it. The parent in the spanning tree is the one sharing the most.
+  void addKeyframe(const Frame::Ptr& keyframe);
+
+  // Erase the keyframe with all its edges. Its children in the spanning tree
+  // are handed over to its parent.
+  void eraseKeyframe(const Frame::Ptr& keyframe);
+
+  // Bump the weights between the keyframe and the other keyframes observing
+  // the map point, once the point has got the observation.
+  void addObservation(const MapPoint::Ptr& point, const Frame::Ptr& keyframe);
+
+  // Drop the weights between the keyframe and the other keyframes observing
+  // the map point, before the point loses the observation.
+  void eraseObservation(const MapPoint::Ptr& point,
+                        const Frame::Ptr& keyframe);
+
+  // Drop the weights between all pairs of keyframes observing the map point,
+  // e.g. once the point is removed from the map.
+  void erasePoint(const MapPoint::Ptr& point);
+
+  // Top n covisible keyframes whose weights exceed
+  // Config::co_kf_weight_thresh(), ranked by decreasing weight.
+  View getCoKfs(const Frame::Ptr& keyframe,
+                const int n = std::numeric_limits<int>::max()) const;
+
+  // Number of map points shared by the two keyframes.
+  int getWeight(const Frame::Ptr& kf_1, const Frame::Ptr& kf_2) const;
+
+  // Parent of the keyframe in the spanning tree, nullptr if it's a root.
+  Frame::Ptr getParent(const Frame::Ptr& keyframe) const;
+
+  vector<Frame::Ptr> getChildren(const Frame::Ptr& keyframe) const;
+
+  void clear();
+
+ private:
+  struct Edge {
+    int id;      // Id of the neighbour.
+    int weight;  // Number of shared map points.
+  };
+
+  struct Node {
+    Frame::Ptr kf{nullptr};
+    vector<Edge> edges;  // Adjacency array, in no particular order.
+    // Position in edges of the edge to each neighbour, keyed by its id.
+    unordered_map<int, int> edge_of;
+    // Covisible keyframes ranked by weight, nullptr if not sorted since the
+    // last change of the weights.
+    mutable sptr<const vector<Frame::Ptr>> sorted{nullptr};
+    int parent = -1;       // Parent id in the spanning tree, -1 if a root.
+    vector<int> children;  // Children ids in the spanning tree.
+  };
+
+  // Add delta to the weight of the edge between the two nodes, creating the
+  // edge if not existing and erasing it once the weight drops to zero.
+  void addWeight(const int id_1, const int id_2, const int delta);
+  void addWeightTo(Node& node, const int id, const int delta);
+
+  // Ids of the keyframes observing the map point, whether present in the
+  // graph or not.
+  static void gatherObservers(const MapPoint::Ptr& point, vector<int>& ids);
+
+  unordered_map<int, Node> nodes_;  // Keyed by keyframe ids.
+
+  mutable std::mutex mut_;
+};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_COVISIBILITY_GRAPH_H_
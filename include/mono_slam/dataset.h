@@ -1,32 +1,60 @@
 #ifndef MONO_SLAM_DATASET_H_
 #define MONO_SLAM_DATASET_H_
 
+#include <deque>
+#include <future>
 #include <string>
 
+#include "mono_slam/utils/thread_pool.h"
 #include "opencv2/core.hpp"
 using cv::Mat;
 using std::string;
 
 namespace mono_slam {
 
+//! Images are read and resized ahead of the tracker by a pool of decode
+//! threads. At most n_prefetch images are loaded or being loaded at any time.
 class Dataset {
  public:
   Dataset(const string& dataset_path, const string& img_file_name_fmt,
-          const double img_resize_factor, const int img_start_idx);
+          const double img_resize_factor, const int img_start_idx,
+          const int n_prefetch, const int n_decode_threads);
 
-  cv::Mat nextImage();
+  // Get next image. Return false if the sequence is exhausted.
+  bool nextImage(cv::Mat& image);
+
+  // Size of the images (after resizing), read from the first image.
+  cv::Size imageSize() const;
 
  private:
+  // Read and resize the img_idx_th image. Empty if not existing.
+  cv::Mat loadImage(const int img_idx) const;
+
+  // Keep the ring of prefetched images full.
+  void prefetch();
+
   // Current image index.
   int img_idx_;
+  // Index of the next image to be prefetched.
+  int prefetch_idx_;
   // Dataset path.
   const string dataset_path_;
   // Image file name format.
   const string img_file_name_fmt_;
   // Image resize factor. A bigger one speeds up tracking.
   const double img_resize_factor_;
+  // Maximum number of images loaded ahead.
+  const int n_prefetch_;
+  // True if an image failed to load, i.e. the end of sequence is reached.
+  bool is_exhausted_;
+
+  // Images being loaded in index order.
+  std::deque<std::future<cv::Mat>> prefetched_images_;
+  //! Declared last such that the workers are joined before other members
+  //! used by the pending tasks are destroyed.
+  ThreadPool::Ptr decode_pool_ = nullptr;
 };
 
 }  // namespace mono_slam
 
-#endif  // MONO_SLAM_DATASET_H_
\ No newline at end of file
+#endif  // MONO_SLAM_DATASET_H_
@@ -19,19 +19,23 @@ struct Feature {
   const Vec2 pt_;             // 2D image point expressed in pixels.
   const cv::Mat descriptor_;  // Corresponding descriptor.
   const int level_;  // Image pyramid level at which the feature is detected.
+  const int idx_;    // Index of the feature in the features of frame_.
   // FIXME Should feature be deleted immediately?
   // Linked 3D map point expressed in world frame.
   //! A feature links only one map point and will not change any more once set.
+  //! Set and reset by feat_utils::linkPoint() and feat_utils::unlinkPoint()
+  //! which keep Frame::is_linked_ in sync.
   wptr<MapPoint> point_;
   bool is_outlier_;  // Is the observation formed with this feature and the
                      // point_ an outlier?
 
   Feature(sptr<Frame> frame, const Vec2& pt, const cv::Mat& descriptor,
-          const int level)
+          const int level, const int idx)
       : frame_(frame),
         pt_(pt),
         descriptor_(descriptor),
         level_(level),
+        idx_(idx),
         is_outlier_(false) {}
 };
 
@@ -56,6 +60,12 @@ inline sptr<Frame> getKeyframe(const sptr<Feature>& feat) {
   return keyframe;
 }
 
+// Link the feature with the map point, or unlink it if point is nullptr, and
+// update the linked flag of the feature in its frame.
+void linkPoint(const sptr<Feature>& feat, const sptr<MapPoint>& point);
+
+void unlinkPoint(const sptr<Feature>& feat);
+
 }  // namespace feat_utils
 }  // namespace mono_slam
 
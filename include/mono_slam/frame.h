@@ -7,6 +7,8 @@
 #include "mono_slam/feature.h"
 #include "mono_slam/g2o_optimizer/g2o_types.h"
 #include "mono_slam/map_point.h"
+#include "mono_slam/matcher/flat_feature_vector.h"
+#include "mono_slam/utils/arena.h"
 
 namespace mono_slam {
 
@@ -28,38 +30,76 @@ class Frame : public std::enable_shared_from_this<Frame> {
   const int id_;                   // Unique frame identity.
   bool is_keyframe_;               // Is this frame a keyframe?
   bool is_datum_;                  // Is this frame fixed as datum?
+  // Arena holding features and descriptors of this frame, released in bulk
+  // once neither the frame nor any of its features is alive.
+  Arena::Ptr arena_{nullptr};
   Features feats_;                 // Features extracted in this frame.
+  // Structure-of-arrays copies of the immutable attributes of feats_ such that
+  // pts_[i], levels_[i] and descriptors_.row(i) belong to feats_[i]. Used in
+  // hot loops to avoid chasing pointers of features.
+  vector<Vec2, Eigen::aligned_allocator<Vec2>> pts_;  // Image points.
+  vector<int> levels_;  // Image pyramid levels.
+  // is_linked_[i] = is feats_[i] linking a map point? Read in matching instead
+  // of the weak pointers of features.
+  //! Set once a feature is linked and cleared once unlinked, hence stays set
+  //! if the map point dies without unlinking, i.e. conservatively skipped.
+  vector<std::uint8_t> is_linked_;
+  // Image points before undistortion, i.e. where features lie in the image.
+  // Only kept if Config::use_klt_tracking().
+  vector<cv::Point2f> raw_pts_;
+  cv::Mat descriptors_;  // Descriptors, one row per feature (CV_8U) stored in
+                         // arena_.
   Camera::Ptr cam_{nullptr};       // Linked camera.
-  DBoW3::BowVector bow_vec_;       // Bag of words vector.
-  DBoW3::FeatureVector feat_vec_;  // Feature vector.
-  cv::Mat img_;                    // Original image. Used for drawing.
-
-  // Temporary variables used for relocalization.
-  int query_frame_id_;     // Id of currently quering frame.
-  int n_sharing_words_;    // Number of sharing words between this and currently
-                           // quering frame.
-  double bow_simi_score_;  // Similarity score between the bag-of-words vector
-                           // of this and that of currently quering frame.
-  bool is_candidate_already_;  // Is this keyframe selected as relocalization
-                               // candidate already?
+  // Bag of words representation, only computed by computeBoW() for keyframes
+  // and frames being relocalized.
+  DBoW3::BowVector bow_vec_;     // Bag of words vector.
+  FlatFeatureVector feat_vec_;   // Feature vector.
+  cv::Mat img_;  // Colour image, only retained if Config::retain_color_imgs().
+  // Grayscale image pyramid shared with the feature extractor. Level 0 is the
+  // grayscale image. Trimmed by releaseImages() once not needed any more.
+  vector<cv::Mat> pyramid_;
 
   // Temporary g2o keyframe vertex storing the optimized result.
   //! No memeory leak since it's freed as the g2o::OptimizableGraph is cleared.
   g2o_types::VertexFrame* v_frame_{nullptr};
 
-  // Variables used for covisibility graph.
-  unordered_map<Frame::Ptr, int> co_kf_weights_;
-  forward_list<Frame::Ptr> co_kfs_;
-  forward_list<int> co_weights_;
+  // Grid of feature indices used for fast searching, stored compactly such
+  // that the indices of features detected at the image pyramid level and
+  // falling in the cell at row r and column c are grid_feats_[k] for k in
+  // [grid_offsets_[cell], grid_offsets_[cell + 1]) where
+  // cell = (level * Config::grid_n_rows() + r) * Config::grid_n_cols() + c.
+  //! Cells of a row are contiguous, hence so are their features.
+  vector<int> grid_offsets_;
+  vector<int> grid_feats_;
 
   // Image bounds.
   static double x_min_;
   static double x_max_;
   static double y_min_;
   static double y_max_;
+  // Inverse of the size of a grid cell (computed along with the bounds).
+  static double grid_cell_width_inv_;
+  static double grid_cell_height_inv_;
 
   Frame(const cv::Mat& img);
 
+  // Compute bag of words representation if not computed yet. Safe to be
+  // called concurrently; the result is computed once and cached.
+  void computeBoW(const DBoW3::Vocabulary& voc);
+
+  // Image used for drawing: the colour image if retained, the grayscale image
+  // otherwise. Empty if released.
+  cv::Mat imgForDrawing() const;
+
+  // Release images not needed any more when this frame is no longer the last
+  // frame. Keyframes keep the grayscale image (and the colour image if
+  // retained) while other frames keep nothing.
+  void releaseImages();
+
+  // Compute image bounds and grid cell sizes shared by all frames. Called once
+  // after camera parameters are set.
+  static void initImageBounds(const cv::Size& img_size);
+
   inline const SE3& pose() const {
     lock_g lock(mut_);
     return cam_->pose();
@@ -80,33 +120,25 @@ class Frame : public std::enable_shared_from_this<Frame> {
     return static_cast<int>(feats_.size());
   }
 
+  // Raw pointer to the descriptor of the i-th feature.
+  inline const uchar* descriptor(const int i) const {
+    return descriptors_.ptr<uchar>(i);
+  }
+
+  // Assign features to the grid cells. Must be called once the features are
+  // extracted and before any searching is performed.
+  void assignFeaturesToGrid();
+
   // Search features given searching radius and image pyramid level range.
   vector<int> searchFeatures(const Vec2& pt, const int radius,
                              const int level_low, const int level_high) const;
 
-  // Check if the given map point is Observable by this frame.
-  bool isObservable(const sptr<MapPoint>& point, const int level) const;
-
-  void addConnection(Frame::Ptr keyframe, const int weight);
-
-  void deleteConnection(const Frame::Ptr& keyframe);
-
-  void updateCoKfsAndWeights();
-
-  void updateCoInfo();
+  // Same as above but writing to feat_indices, such that the buffer is reused.
+  void searchFeatures(const Vec2& pt, const int radius, int level_low,
+                      int level_high, vector<int>& feat_indices) const;
 
   double computeSceneMedianDepth();
 
-  inline forward_list<Frame::Ptr> getCoKfs(
-      const int n = std::numeric_limits<int>::max()) const {
-    lock_g lock(co_mut_);
-    const int n_kfs =
-        static_cast<int>(std::distance(co_kfs_.cbegin(), co_kfs_.cend()));
-    if (n > n_kfs) return co_kfs_;
-    return forward_list<Frame::Ptr>(co_kfs_.cbegin(),
-                                    std::next(co_kfs_.cbegin(), n));
-  }
-
   // FIXME This method is deprecated!
   // Compute number of tracked map points (i.e. ones that are observed by more
   // than min_n_obs frames).
@@ -119,16 +151,15 @@ class Frame : public std::enable_shared_from_this<Frame> {
  private:
   // Mutexes.
   mutable std::mutex mut_;  // General data guardian.
-  // Protect concurrent modification on covisible info.
-  mutable std::mutex co_mut_;
+  std::once_flag bow_once_;  // Compute bag of words only once.
 };
 
 namespace frame_utils {
 
-void undistortKeypoints(const Mat33& K, const Vec4& dist_coeffs,
-                        std::vector<cv::KeyPoint>& kpts);
+// Undistort keypoints by bilinearly interpolating Camera::undist_map_.
+void undistortKeypoints(std::vector<cv::KeyPoint>& kpts);
 
-void computeImageBounds(const cv::Mat& img, const Mat33& K,
+void computeImageBounds(const cv::Size& img_size, const Mat33& K,
                         const Vec4& dist_coeffs, cv::Mat& corners);
 
 }  // namespace frame_utils
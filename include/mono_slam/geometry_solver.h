@@ -15,9 +15,11 @@ class MapPoint;
 class GeometrySolver {
  public:
   // Find fundamental matrix using eight-point algorithm in a RANSAC scheme.
+  // Matches are pairs of feature indices (idx_1, idx_2).
   static void findFundamentalRansac(const Frame::Ptr& frame_1,
                                     const Frame::Ptr& frame_2,
-                                    const vector<int>& matches, Mat33& F,
+                                    const vector<pair<int, int>>& matches,
+                                    Mat33& F,
                                     vector<pair<int, int>>& inlier_matches,
                                     const double noise_sigma = 3.0,
                                     const double max_n_iters = 200,
@@ -54,7 +56,15 @@ class GeometrySolver {
   // Find the best relative pose frame relocalization candidate keyframe to
   // quering frame.
   static bool P3PRansac(const Frame::Ptr& keyframe, const Frame::Ptr& frame,
-                        const vector<int>& matches, SE3& relative_pose,
+                        const vector<pair<int, int>>& matches,
+                        SE3& relative_pose,
+                        const double noise_sigma = 3.0);
+
+  // Same as above but given the 3D-2D correspondences between points and
+  // feats of frame directly, such that points[i] is observed by feats[i].
+  static bool P3PRansac(const Frame::Ptr& frame,
+                        const vector<MapPoint::Ptr>& points,
+                        const vector<Feature::Ptr>& feats, SE3& pose,
                         const double noise_sigma = 3.0);
 
   // Evaluate the scores of the four solutions obtained from Kneip P3P. The best
@@ -3,6 +3,7 @@
 
 #include "mono_slam/common_include.h"
 #include "mono_slam/frame.h"
+#include "mono_slam/matcher.h"
 #include "mono_slam/tracking.h"
 
 namespace mono_slam {
@@ -45,7 +46,7 @@ class Initializer {
  private:
   // Compute relative pose from ref_frame_ to curr_frame_ and triangulate points
   // by the way.
-  bool initialize(const vector<int>& matches);
+  bool initialize(const MatchList& matches);
 
   // Build initial map.
   bool buildInitMap();
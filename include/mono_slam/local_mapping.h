@@ -6,6 +6,7 @@
 #include "mono_slam/map.h"
 #include "mono_slam/system.h"
 #include "mono_slam/tracking.h"
+#include "mono_slam/utils/thread_pool.h"
 
 namespace mono_slam {
 
@@ -61,6 +62,9 @@ class LocalMapping {
   sptr<System> system_ = nullptr;
   sptr<Tracking> tracker_ = nullptr;
   Map::Ptr map_ = nullptr;
+
+  // Thread pool searching matches for triangulation in parallel.
+  ThreadPool::Ptr thread_pool_ = nullptr;
 };
 
 }  // namespace mono_slam
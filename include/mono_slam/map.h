@@ -4,8 +4,12 @@
 #include "DBoW3/DBoW3.h"
 #include "mono_slam/common_include.h"
 #include "mono_slam/config.h"
+#include "mono_slam/covisibility_graph.h"
 #include "mono_slam/frame.h"
 #include "mono_slam/map_point.h"
+#include "mono_slam/matcher/descriptor_index.h"
+#include "mono_slam/utils/epoch.h"
+#include "mono_slam/utils/slot_vector.h"
 
 using DBoW3::Vocabulary;
 
@@ -18,7 +22,7 @@ class KeyframeDataBase {
  public:
   using Ptr = uptr<KeyframeDataBase>;
 
-  KeyframeDataBase(sptr<Vocabulary> voc);
+  KeyframeDataBase(sptr<Vocabulary> voc, const CovisibilityGraph* co_graph);
 
   // Add to the lists of keyframes the keyframe sharing words with them.
   void add(Frame::Ptr keyframe);
@@ -40,6 +44,8 @@ class KeyframeDataBase {
   unordered_map<int, list<Frame::Ptr>> inv_files_;
 
   const sptr<Vocabulary> voc_{nullptr};  // Vocabulary.
+  // Covisibility graph of the map, grouping candidates with their neighbours.
+  const CovisibilityGraph* co_graph_{nullptr};
 
   std::mutex mut_;
 };
@@ -47,11 +53,64 @@ class KeyframeDataBase {
 struct Feature;
 class MapPoint;
 
+// Changes of the map from one published version to the next.
+struct MapDelta {
+  using Ptr = sptr<const MapDelta>;
+
+  std::uint64_t version;  // Version the changes lead to.
+  vector<Frame::Ptr> added_kfs;
+  vector<MapPoint::Ptr> added_points;
+  vector<int> removed_kf_ids;
+  vector<int> removed_point_ids;
+};
+
+// Immutable view of the keyframes and map points published by the map, read
+// by other threads without locking the map.
+class MapSnapshot {
+ public:
+  using Ptr = sptr<const MapSnapshot>;
+  // Number of latest deltas retained in a snapshot.
+  static constexpr int kMaxNumDeltas = 32;
+
+  inline std::uint64_t version() const { return version_; }
+
+  // Keyframes and map points, in no particular order.
+  inline const SlotVector<Frame::Ptr>::Snapshot& keyframes() const {
+    return kfs_;
+  }
+  inline const SlotVector<MapPoint::Ptr>::Snapshot& mapPoints() const {
+    return points_;
+  }
+
+  inline int nKfs() const { return kfs_.size(); }
+  inline int nPoints() const { return points_.size(); }
+
+  // Changes from the version since to this version, oldest first. Return
+  // false if some are not retained any more, in which case the reader should
+  // start over from this snapshot.
+  bool getChangesSince(const std::uint64_t since,
+                       vector<MapDelta::Ptr>& deltas) const;
+
+ private:
+  friend class Map;
+
+  std::uint64_t version_ = 0;
+  SlotVector<Frame::Ptr>::Snapshot kfs_;
+  SlotVector<MapPoint::Ptr>::Snapshot points_;
+  // Latest deltas, the last one leading to this version.
+  vector<MapDelta::Ptr> deltas_;
+};
+
 class Map {
  public:
   using Ptr = sptr<Map>;
+  // Covisibility graph of the keyframes in the map.
+  CovisibilityGraph::Ptr co_graph_{nullptr};
   // Keyframe database used for relocalization.
   KeyframeDataBase::Ptr kf_db_{nullptr};
+  // Index of the descriptors of map points used for matching against the
+  // whole map. Kept in sync as map points are inserted, updated and removed.
+  DescriptorIndex::Ptr point_index_{nullptr};
 
   mutable std::mutex mut_;
 
@@ -61,14 +120,24 @@ class Map {
 
   void insertMapPoint(MapPoint::Ptr point);
 
+  // Remove the keyframe from the map and the covisibility graph. Its removal
+  // from the keyframe database is deferred to collectGarbage().
   void removeKeyframe(const Frame::Ptr& keyframe);
 
-  void removeBadMapPoints();
-
-  // TODO(bayes) Implement remove functions, e.g. put outlier map points to
-  // trash and empty trash properly. And more function like svo.
+  // Unlink the observation and mark the map point as bad if it's observed by
+  // too few keyframes. Bad map points are unlinked from all features at once
+  // while their removal from the map is deferred to collectGarbage().
   void removeBadObservations(const Frame::Ptr& keyframe, Feature::Ptr& feat);
 
+  // Remove in a batch the bad map points and keyframes from the map, publish
+  // a new snapshot of the map, and release those removed in earlier epochs no
+  // reader is pinning any more. Called once per local mapping iteration.
+  void collectGarbage();
+
+  // Pin the current epoch such that map points and keyframes are not released
+  // during the access of the reader, e.g. while tracking a frame.
+  inline EpochManager::Guard pinEpoch() { return epochs_.pin(); }
+
   inline int nKfs() const {
     lock_g lock(mut_);
     return static_cast<int>(kfs_.size());
@@ -79,21 +148,44 @@ class Map {
     return static_cast<int>(points_.size());
   }
   
-  inline list<Frame::Ptr> getAllKeyframes() const {
+  // Latest published snapshot, grabbed by a single atomic load such that
+  // readers, e.g. the viewer, never contend with the local mapper.
+  inline MapSnapshot::Ptr getSnapshot() const {
+    return std::atomic_load(&snapshot_);
+  }
+
+  // Copies of keyframes and map points, in no particular order, including
+  // the changes not published yet.
+  inline vector<Frame::Ptr> getAllKeyframes() const {
     lock_g lock(mut_);
-    return kfs_;
+    return kfs_.values();
   }
 
-  inline list<MapPoint::Ptr> getAllMapPoints() const {
+  inline vector<MapPoint::Ptr> getAllMapPoints() const {
     lock_g lock(mut_);
-    return points_;
+    return points_.values();
   }
 
   void clear();
 
  private:
-  list<Frame::Ptr> kfs_;        // Maintained keyframes.
-  list<MapPoint::Ptr> points_;  // Maintained map points;
+  // Publish the changes since the last snapshot as a new snapshot.
+  void publishSnapshot();
+
+  // Maintained keyframes and map points, keyed by their ids.
+  SlotVector<Frame::Ptr> kfs_;
+  SlotVector<MapPoint::Ptr> points_;
+  // Map points marked bad and keyframes removed since the last collection.
+  vector<MapPoint::Ptr> bad_points_;
+  vector<Frame::Ptr> bad_kfs_;
+  // Objects removed from the map tagged with the epochs they were removed in,
+  // kept alive till no reader could access them.
+  deque<pair<std::uint64_t, MapPoint::Ptr>> retired_points_;
+  deque<pair<std::uint64_t, Frame::Ptr>> retired_kfs_;
+  EpochManager epochs_;
+  // Changes since the last published snapshot.
+  MapDelta pending_delta_;
+  MapSnapshot::Ptr snapshot_{nullptr};  //! Only accessed atomically.
   int max_kf_id_;  // Maximum id of keyframes inserted so far. Used for
                    // checking for duplication as new keyframe is comming.
   sptr<Vocabulary> voc_{nullptr};
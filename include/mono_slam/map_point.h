@@ -6,6 +6,7 @@
 #include "mono_slam/feature.h"
 #include "mono_slam/frame.h"
 #include "mono_slam/g2o_optimizer/g2o_types.h"
+#include "mono_slam/matcher/hamming.h"
 
 namespace mono_slam {
 
@@ -19,38 +20,20 @@ class MapPoint {
   //! need to temporarily share it with scoped container to do stuff. Hence
   //! shared_ptr.
   using Ptr = sptr<MapPoint>;
+  // Observations are published as immutable snapshots, such that readers share
+  // the current version without copying or locking while writers publish new
+  // versions. A snapshot stays valid as long as it's held.
+  using Observations = vector<sptr<Feature>>;
+  using ObsSnapshot = sptr<const Observations>;
 
   static int point_cnt_;  // Global map point counter, starting from 0.
   const int id_;          // Unique map point identity.
   Vec3 pos_;              // Position in world frame.
-  //! TODO(bayes) Use weak_ptr. Although a single-side weak_ptr could resolve
-  //! cyclic reference issue, we still declare Feature of type weak_ptr since in
-  //! our design, Feature is exclusively owned by Frame.
-  list<sptr<Feature>> observations_;  // List of observations.
-  sptr<Feature> best_feat_;  // Best feature in that its descriptor has the
-                             // least median distance against other features.
-                             // Used for fast matching.
-
-  // These two variables are used in Frame::isObservable. \sa
-  // Frame::isObservable.
+  // These two variables are used in visibility tests. \sa
+  // matcher_utils::projectLocalPoints.
   Vec3 median_view_dir_;   // Median viewing direction (a unit vector).
   int median_view_scale_;  // Median viewing scale (aka. image pyramid level).
 
-  // Temporary variables used for searching. These variables are updated as
-  // Frame::isObservable() is called. \sa Frame::isObservable().
-  int curr_tracked_frame_id_;  // Temporary marker storing the id of currently
-                               // tracked frame to avoid repeat insertion.
-  double repr_x_;  // x coordinate reprojected on currently tracked frame.
-  double repr_y_;  // y coordinate reprojected on currently tracked frame.
-  int level_;  // Estimated image pyramid level at which searching is performed.
-  double cos_view_dir_;  // Cosine of viewing direction from the camera center
-                         // of currently tracked frame.
-
-  // Temporary variables used for optimization.
-  int curr_ba_keyframe_id_;  // Temporary marker storing the id of currently
-                             // bundle-adjusted keyframe to avoid repeat
-                             // insertion.
-
   // Temporary g2o point vertex storing the optimized result.
   //! No memeory leak since it's freed as the g2o::OptimizableGraph is cleared.
   g2o_types::VertexPoint* v_point_{nullptr};
@@ -73,9 +56,7 @@ class MapPoint {
   void setPos(const Vec3& pos);
 
   inline int nObs() const {
-    u_lock lock(mutex_);
-    //! Since C++11, all(?) STL containers' size() is constant complexity.
-    return observations_.size();
+    return static_cast<int>(getObservations()->size());
   }
 
   // Add an observation.
@@ -85,12 +66,39 @@ class MapPoint {
   // Erase an observation.
   void eraseObservation(const sptr<Feature>& feat);
 
-  inline list<sptr<Feature>> getObservations() const {
+  // Current snapshot of observations.
+  //! Bind the result to a variable before iterating, e.g.
+  //! `const ObsSnapshot obs = getObservations(); for (feat : *obs) ...`.
+  inline ObsSnapshot getObservations() const {
+    return std::atomic_load(&observations_);
+  }
+
+  // Representative descriptor, i.e. the descriptor of the observation having
+  // the least median distance against other observations. Used for fast
+  // matching. \sa updateDescriptor.
+  //! Zero-padded beyond descriptorBytes() bytes.
+  inline DescBuffer descriptor() const {
     u_lock lock(mutex_);
-    return observations_;
+    return descriptor_;
   }
 
-  void updateBestFeature();
+  // Length in bytes of the descriptors of observations, e.g. 32 for ORB.
+  inline int descriptorBytes() const {
+    u_lock lock(mutex_);
+    return desc_bytes_;
+  }
+
+  // Has the representative descriptor been computed?
+  inline bool hasDescriptor() const {
+    u_lock lock(mutex_);
+    return has_descriptor_;
+  }
+
+  // Select the representative descriptor among the observations.
+  //! Pairwise distances between the descriptors of observations are cached and
+  //! extended in O(n) as observations are added. They are only recomputed
+  //! after an observation was erased.
+  void updateDescriptor();
 
   void updateMedianViewDirAndScale();
 
@@ -100,6 +108,33 @@ class MapPoint {
   bool isObservedBy(const sptr<Frame>& frame) const;
 
  private:
+  // Publish a new version of observations. Must be called with mutex_ held.
+  inline void publishObservations(ObsSnapshot observations) {
+    std::atomic_store(&observations_, std::move(observations));
+  }
+
+  // Add the descriptor of an observation to the cached distances.
+  void addObsDescriptor(const sptr<Feature>& feat);
+
+  //! Stored inline rather than through the best feature such that matching
+  //! reads it without chasing pointers.
+  DescBuffer descriptor_;
+  int desc_bytes_ = 0;
+  bool has_descriptor_ = false;
+  // Descriptors of observations in the order they were added and their
+  // pairwise distances, such that obs_dists_[i][j] = dist(obs_descs_[i],
+  // obs_descs_[j]).
+  vector<DescBuffer> obs_descs_;
+  vector<vector<int>> obs_dists_;
+  bool is_obs_dists_stale_ = false;  // Set once an observation is erased.
+
+  //! TODO(bayes) Use weak_ptr. Although a single-side weak_ptr could resolve
+  //! cyclic reference issue, we still declare Feature of type weak_ptr since in
+  //! our design, Feature is exclusively owned by Frame.
+  //! Only accessed through std::atomic_load and std::atomic_store. Writers
+  //! are serialized by mutex_.
+  ObsSnapshot observations_;
+
   mutable std::mutex mutex_;
 };
 
@@ -3,35 +3,211 @@
 
 #include "mono_slam/common_include.h"
 #include "mono_slam/frame.h"
+#include "mono_slam/matcher/descriptor_traits.h"
+#include "mono_slam/utils/thread_pool.h"
 
 namespace mono_slam {
 
-class Matcher {
+namespace matcher_utils {
+
+// Map points observed by local keyframes, gathered into contiguous arrays such
+// that they could be projected onto a frame and culled in a single vectorized
+// pass. \sa Matcher::searchByProjection.
+//! The arrays only grow, such that they are reused without reallocation, and
+//! only their first size() columns are valid.
+struct LocalPoints {
+  vector<sptr<MapPoint>> points;  // Unique map points.
+  Matrix3Xd positions;            // Positions in world frame.
+  Matrix3Xd view_dirs;            // Median viewing directions.
+  ArrayXi median_scales;          // Median viewing scales.
+  // Image pyramid levels of the features the points are gathered from, used as
+  // the predicted levels at which searching is performed.
+  ArrayXi levels;
+  vector<DescBuffer> descs;  // Representative descriptors.
+
+  // Results of projection. Only valid for the points indexed by visible.
+  Matrix2Xd repr_pts;     // Image points reprojected on the frame.
+  ArrayXd cos_view_dirs;  // Cosine of viewing directions from the camera
+                          // center of the frame.
+  vector<int> visible;    // Indices of points passing all visibility tests.
+
+  // Scratch of projection.
+  Matrix3Xd points_c;  // Positions in camera frame.
+  Matrix3Xd rays;      // Rays from the camera center of the frame.
+  Array<bool, Dynamic, 1> is_visible;
+
+  inline int size() const { return static_cast<int>(points.size()); }
+
+  // Ensure the arrays could hold n points.
+  void reserve(const int n);
+};
+
+// Features of a frame indexed by the epipolar line they lie on, i.e. by the
+// angle of the line through them and the epipole, such that the features lying
+// in a band around an epipolar line are found without testing all of them.
+//! As the band around a line through the epipole is a wedge whose angular
+//! width shrinks with the distance to the epipole, features are grouped into
+//! rings of doubling radii around the epipole and sorted by angle within each
+//! ring. A band is then searched with a binary search per ring.
+class EpipolarIndex {
+ public:
+  // Index the features of frame indexed by indices given the epipole expressed
+  // in homogeneous image coordinates, replacing those indexed before.
+  void build(const Frame::Ptr& frame, const vector<int>& indices,
+             const Vec3& epipole);
+
+  // Append to candidates the indices of features whose distance to the
+  // epipolar line, i.e. a line through the epipole, is probably below
+  // max_dist. The result is a superset of such features.
+  void searchBand(const Vec3& epi_line, const double max_dist,
+                  vector<unsigned int>& candidates) const;
+
+ private:
+  struct Entry {
+    double angle;  // Angle of the line through the feature, in [0, pi).
+    int idx;       // Index of the feature.
+    bool operator<(const Entry& other) const { return angle < other.angle; }
+  };
+
+  // Radius of ring 0, ring k > 0 covers [2^(k-1), 2^k) * kRingRadius.
+  static constexpr double kRingRadius = 16.;
+
+  Vec2 epipole_;
+  Vec2 center_;  // Centroid of the features.
+  vector<vector<Entry>> rings_;  // Features sorted by angle in each ring.
+};
+
+}  // namespace matcher_utils
+
+// Compact list of matches between the features of two frames as pairs of
+// feature indices (idx_1, idx_2).
+using MatchList = vector<pair<int, int>>;
+
+// Buffers reused across matching calls. They keep their capacity, hence
+// matching performs no heap allocation once they have grown to the
+// steady-state sizes. A workspace is used by one thread at a time; local()
+// returns the workspace of the calling thread.
+//! Results are written to the MatchList passed in, which is cleared first and
+//! hence reused likewise if kept by the caller.
+struct MatchWorkspace {
+  // Used by searchByProjection.
+  matcher_utils::LocalPoints local_points;
+  vector<int> best_indices;  // Best feature of each visible point.
+  vector<int> best_dists;    // Descriptor distance of the best feature.
+  vector<int> claims;        // Visible point claiming each feature.
+  // Used by searchForTriangulation.
+  matcher_utils::EpipolarIndex epi_index;
+  vector<int> unmatched;            // Features linking no map point.
+  vector<unsigned int> candidates;  // Features around an epipolar line.
+  // Shared by all searching.
+  vector<std::uint8_t> matched;  // Is each feature of the second frame matched?
+  vector<int> feat_indices;      // Features found by Frame::searchFeatures.
+  vector<int> dists;             // Descriptor distances against candidates.
+
+  static MatchWorkspace& local();
+};
+
+// Feature matching templated on the traits of the descriptors extracted in
+// frames such that their lengths are compile-time constants, e.g. Orb256.
+// \sa BinaryDescriptor.
+//! Instantiated in matcher.cc for Orb256, Brisk512 and Akaze486. Map points
+//! keep their representative descriptors in DescBuffer, holding up to 512 bits.
+template <typename Desc>
+class BasicMatcher {
  public:
   // Search feature correspondences between the two views used for
   // initialization.
-  static int searchForInitialization(const Frame::Ptr& frame_1,
-                                     const Frame::Ptr& frame_2,
-                                     vector<int>& matches);
+  static int searchForInitialization(
+      const Frame::Ptr& frame_1, const Frame::Ptr& frame_2, MatchList& matches,
+      MatchWorkspace& ws = MatchWorkspace::local());
 
   static int searchByProjection(const unordered_set<Frame::Ptr>& frames,
-                                const Frame::Ptr& curr_frame);
+                                const Frame::Ptr& curr_frame,
+                                MatchWorkspace& ws = MatchWorkspace::local());
 
   static int searchByProjection(const Frame::Ptr& last_frame,
-                                const Frame::Ptr& curr_frame);
+                                const Frame::Ptr& curr_frame,
+                                MatchWorkspace& ws = MatchWorkspace::local());
 
   static int searchByBoW(const Frame::Ptr& keyframe, const Frame::Ptr& frame,
-                         vector<int>& matches);
+                         MatchList& matches,
+                         MatchWorkspace& ws = MatchWorkspace::local());
 
-  static int searchForTriangulation(const Frame::Ptr& keyframe_1,
-                                    const Frame::Ptr& keyframe_2,
-                                    vector<int>& matches);
+  static int searchForTriangulation(
+      const Frame::Ptr& keyframe_1, const Frame::Ptr& keyframe_2,
+      MatchList& matches, MatchWorkspace& ws = MatchWorkspace::local());
 };
 
+// Matcher of the ORB descriptors extracted by ORBExtractor.
+using Matcher = BasicMatcher<Orb256>;
+
 namespace matcher_utils {
 
-//@ref http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-int computeDescDist(const cv::Mat& desc_1, const cv::Mat& desc_2);
+// Thread pool shared by all matching running in parallel, including the
+// queries of DescriptorIndex.
+ThreadPool& threadPool();
+
+// Gather the unique map points observed by keyframes.
+void gatherLocalPoints(const unordered_set<Frame::Ptr>& keyframes,
+                       LocalPoints& local_points);
+
+// Gather the map points observed by a single frame.
+void gatherLocalPoints(const Frame::Ptr& frame, LocalPoints& local_points);
+
+// Project all local points onto frame at once and keep the visible ones, i.e.
+// points having positive depth, falling in image bounds, having consistent
+// scale and having viewing direction within 60 degrees of their median
+// viewing direction.
+void projectLocalPoints(const Frame::Ptr& frame, LocalPoints& local_points);
+
+// Hamming distance between two descriptors.
+template <typename Desc = Orb256>
+inline int computeDescDist(const uchar* desc_1, const uchar* desc_2) {
+  return Desc::distance(desc_1, desc_2);
+}
+
+// Same as above but given the descriptors as cv::Mat.
+template <typename Desc = Orb256>
+inline int computeDescDist(const cv::Mat& desc_1, const cv::Mat& desc_2) {
+  return Desc::distance(desc_1.ptr<uchar>(), desc_2.ptr<uchar>());
+}
+
+// Compute in a batch the distances between the descriptor and those of the
+// n_indices features listed from indices in frame, such that dists[i] =
+// dist(desc, frame->descriptor(indices[i])).
+template <typename Desc = Orb256>
+inline void computeDescDists(const uchar* desc, const Frame::Ptr& frame,
+                             const int* indices, const int n_indices,
+                             vector<int>& dists) {
+  dists.resize(n_indices);
+  Desc::distanceOneToIndexed(desc, frame->descriptors_.ptr<uchar>(),
+                             frame->descriptors_.step, indices, n_indices,
+                             dists.data());
+}
+
+// Same as above but taking unsigned indices, e.g. those of a node of
+// FlatFeatureVector.
+template <typename Desc = Orb256>
+inline void computeDescDists(const uchar* desc, const Frame::Ptr& frame,
+                             const unsigned int* indices, const int n_indices,
+                             vector<int>& dists) {
+  //! Accessing unsigned int through int is well-defined.
+  computeDescDists<Desc>(desc, frame, reinterpret_cast<const int*>(indices),
+                         n_indices, dists);
+}
+
+template <typename Desc = Orb256>
+inline void computeDescDists(const uchar* desc, const Frame::Ptr& frame,
+                             const vector<int>& indices, vector<int>& dists) {
+  computeDescDists<Desc>(desc, frame, indices.data(), indices.size(), dists);
+}
+
+template <typename Desc = Orb256>
+inline void computeDescDists(const uchar* desc, const Frame::Ptr& frame,
+                             const vector<unsigned int>& indices,
+                             vector<int>& dists) {
+  computeDescDists<Desc>(desc, frame, indices.data(), indices.size(), dists);
+}
 
 }  // namespace matcher_utils
 }  // namespace mono_slam
@@ -0,0 +1,84 @@
+#ifndef MONO_SLAM_MATCHER_DESCRIPTOR_INDEX_H_
+#define MONO_SLAM_MATCHER_DESCRIPTOR_INDEX_H_
+
+#include <array>
+#include <shared_mutex>
+
+#include "mono_slam/common_include.h"
+#include "mono_slam/map_point.h"
+#include "mono_slam/matcher/hamming.h"
+
+namespace mono_slam {
+
+class MapPoint;
+
+// Multi-index hashing (MIH) index over the representative descriptors of map
+// points, supporting exact k nearest neighbor queries in Hamming space against
+// the whole map. Only 256-bit descriptors, e.g. ORB, are indexed.
+//! A descriptor is split into kNumChunks disjoint 16-bit substrings, each
+//! indexing a hash table. By the pigeonhole principle, two descriptors within
+//! distance kNumChunks * (r + 1) - 1 have at least one substring within
+//! distance r. Hence querying the tables with growing substring radius r finds
+//! all the nearest neighbors while only a small portion of the map is
+//! compared. See Norouzi et al., "Fast Exact Search in Hamming Space with
+//! Multi-Index Hashing", TPAMI 2014.
+class DescriptorIndex {
+ public:
+  using Ptr = uptr<DescriptorIndex>;
+
+  struct Neighbor {
+    MapPoint::Ptr point;
+    int dist;  // Hamming distance to the query descriptor.
+  };
+
+  // Index the map point by its representative descriptor. The point is
+  // re-indexed if indexed already, e.g. after its descriptor was updated.
+  void insert(const MapPoint::Ptr& point);
+
+  // Remove the map point if indexed.
+  void erase(const MapPoint::Ptr& point);
+
+  void clear();
+
+  inline int size() const {
+    std::shared_lock<std::shared_mutex> lock(mut_);
+    return static_cast<int>(slot_of_point_.size());
+  }
+
+  // Find for each row of descriptors (CV_8U, 32 columns) at most k nearest map
+  // points within max_dist, sorted by distance, such that neighbors[i] are the
+  // neighbors of descriptors.row(i). Queries are run in parallel.
+  void knnSearch(const cv::Mat& descriptors, const int k, const int max_dist,
+                 vector<vector<Neighbor>>& neighbors) const;
+
+ private:
+  static constexpr int kNumChunks = 16;
+  static constexpr int kChunkBits = 16;
+
+  // The chunk_th 16-bit substring of desc.
+  static inline std::uint16_t chunk(const Desc256& desc, const int chunk) {
+    return static_cast<std::uint16_t>(desc.words_[chunk / 4] >>
+                                      (kChunkBits * (chunk % 4)));
+  }
+
+  // Remove the entry in the slot from the tables.
+  void eraseSlot(const int slot);
+
+  // Query of a single descriptor. Must be called with the lock held.
+  void searchOne(const Desc256& query, const int k, const int max_dist,
+                 vector<Neighbor>& neighbors) const;
+
+  // Entries are kept in slots reused once freed, such that the tables store
+  // slot indices.
+  vector<Desc256> descs_;                    // Descriptor of each slot.
+  vector<wptr<MapPoint>> points_;            // Map point of each slot.
+  vector<int> free_slots_;                   // Slots not in use.
+  unordered_map<int, int> slot_of_point_;    // Map point id -> slot.
+  // tables_[c][v] = slots whose c_th substring equals v.
+  std::array<unordered_map<std::uint16_t, vector<int>>, kNumChunks> tables_;
+  mutable std::shared_mutex mut_;
+};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_MATCHER_DESCRIPTOR_INDEX_H_
@@ -0,0 +1,68 @@
+#ifndef MONO_SLAM_MATCHER_DESCRIPTOR_TRAITS_H_
+#define MONO_SLAM_MATCHER_DESCRIPTOR_TRAITS_H_
+
+#include <cstddef>  // std::size_t
+#include <cstdint>  // std::uint8_t
+
+#include "mono_slam/matcher/hamming.h"
+
+namespace mono_slam {
+
+// Traits of a binary descriptor of kNumBits bits, stored as one row of
+// kBytes bytes (CV_8U) per feature. Matching is templated on the traits such
+// that the lengths are compile-time constants.
+//! Matching thresholds are tuned for 256-bit ORB descriptors and scaled
+//! linearly with the length by scaleThresh.
+template <int kNumBits>
+struct BinaryDescriptor {
+  static constexpr int kBits = kNumBits;
+  static constexpr int kBytes = (kNumBits + 7) / 8;
+
+  // Scale a distance threshold tuned for 256-bit descriptors.
+  static constexpr int scaleThresh(const int thresh) {
+    return thresh * kBits / 256;
+  }
+
+  static inline int distance(const std::uint8_t* desc_1,
+                             const std::uint8_t* desc_2) {
+    return hamming::distanceFixed<kBytes>(desc_1, desc_2);
+  }
+
+  // Same as hamming::distanceOneToIndexed.
+  static inline void distanceOneToIndexed(const std::uint8_t* query,
+                                          const std::uint8_t* train,
+                                          const std::size_t train_stride,
+                                          const int* indices,
+                                          const int n_indices, int* dists) {
+    for (int i = 0; i < n_indices; ++i)
+      dists[i] = distance(query, train + indices[i] * train_stride);
+  }
+};
+
+// ORB and BRIEF-256, using the kernels selected for the running CPU.
+struct Orb256 : BinaryDescriptor<256> {
+  static inline int distance(const std::uint8_t* desc_1,
+                             const std::uint8_t* desc_2) {
+    return hamming::distance(desc_1, desc_2);
+  }
+
+  static inline void distanceOneToIndexed(const std::uint8_t* query,
+                                          const std::uint8_t* train,
+                                          const std::size_t train_stride,
+                                          const int* indices,
+                                          const int n_indices, int* dists) {
+    hamming::distanceOneToIndexed(query, train, train_stride, indices,
+                                  n_indices, dists);
+  }
+};
+
+// BRISK.
+struct Brisk512 : BinaryDescriptor<512> {};
+
+// AKAZE with the full MLDB descriptor, stored in 61 bytes whose last 2 bits
+// are zero.
+struct Akaze486 : BinaryDescriptor<486> {};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_MATCHER_DESCRIPTOR_TRAITS_H_
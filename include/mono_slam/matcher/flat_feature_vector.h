@@ -0,0 +1,110 @@
+#ifndef MONO_SLAM_MATCHER_FLAT_FEATURE_VECTOR_H_
+#define MONO_SLAM_MATCHER_FLAT_FEATURE_VECTOR_H_
+
+#include <algorithm>  // std::lower_bound
+#include <cstddef>    // std::ptrdiff_t
+#include <vector>
+
+namespace DBoW3 {
+class FeatureVector;
+}
+
+namespace mono_slam {
+
+// Feature vector of a frame, i.e. the indices of features grouped by the
+// vocabulary node they fall in, stored in two contiguous arrays: the nodes
+// sorted by id, each holding a range into a single packed buffer of feature
+// indices. Replaces DBoW3::FeatureVector, a std::map of vectors, such that
+// matching nodes of two frames walks memory linearly.
+class FlatFeatureVector {
+ public:
+  struct Node {
+    unsigned int id;     // Vocabulary node id.
+    unsigned int begin;  // Range [begin, end) into the feature indices.
+    unsigned int end;
+  };
+
+  // Flatten the feature vector computed by DBoW3::Vocabulary::transform.
+  void assign(const DBoW3::FeatureVector& feat_vec);
+
+  void clear() {
+    nodes_.clear();
+    indices_.clear();
+  }
+
+  inline bool empty() const { return nodes_.empty(); }
+  inline int size() const { return static_cast<int>(nodes_.size()); }
+  inline const std::vector<Node>& nodes() const { return nodes_; }
+
+  // Feature indices in the node, in [first(node), last(node)).
+  inline const unsigned int* first(const Node& node) const {
+    return indices_.data() + node.begin;
+  }
+  inline const unsigned int* last(const Node& node) const {
+    return indices_.data() + node.end;
+  }
+  inline int count(const Node& node) const {
+    return static_cast<int>(node.end - node.begin);
+  }
+
+  // Call fn(node_1, node_2) for each pair of nodes of vec_1 and vec_2 having
+  // the same id, in increasing order of ids.
+  //! A merge-join where the lagging side catches up by galloping, i.e. an
+  //! exponential search followed by a binary search, hence a frame having
+  //! few nodes is joined with one having many in sublinear time.
+  template <typename Fn>
+  static void join(const FlatFeatureVector& vec_1,
+                   const FlatFeatureVector& vec_2, Fn&& fn);
+
+ private:
+  // Position of the first node in [it, end) whose id is not less than id.
+  static std::vector<Node>::const_iterator gallop(
+      std::vector<Node>::const_iterator it,
+      const std::vector<Node>::const_iterator end, const unsigned int id);
+
+  std::vector<Node> nodes_;            // Sorted by id.
+  std::vector<unsigned int> indices_;  // Feature indices of all nodes.
+};
+
+inline std::vector<FlatFeatureVector::Node>::const_iterator
+FlatFeatureVector::gallop(std::vector<Node>::const_iterator it,
+                          const std::vector<Node>::const_iterator end,
+                          const unsigned int id) {
+  // Double the step till overshooting, then search within the last step.
+  std::ptrdiff_t step = 1;
+  auto low = it;
+  while (it != end && it->id < id) {
+    low = it;
+    if (end - it <= step) {
+      it = end;
+      break;
+    }
+    it += step;
+    step *= 2;
+  }
+  return std::lower_bound(
+      low, it, id,
+      [](const Node& node, const unsigned int key) { return node.id < key; });
+}
+
+template <typename Fn>
+void FlatFeatureVector::join(const FlatFeatureVector& vec_1,
+                             const FlatFeatureVector& vec_2, Fn&& fn) {
+  auto it_1 = vec_1.nodes_.cbegin(), it_1_end = vec_1.nodes_.cend();
+  auto it_2 = vec_2.nodes_.cbegin(), it_2_end = vec_2.nodes_.cend();
+  while (it_1 != it_1_end && it_2 != it_2_end) {
+    if (it_1->id == it_2->id) {
+      fn(*it_1, *it_2);
+      ++it_1;
+      ++it_2;
+    } else if (it_1->id < it_2->id) {
+      it_1 = gallop(it_1, it_1_end, it_2->id);
+    } else {
+      it_2 = gallop(it_2, it_2_end, it_1->id);
+    }
+  }
+}
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_MATCHER_FLAT_FEATURE_VECTOR_H_
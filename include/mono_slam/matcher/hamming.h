@@ -0,0 +1,115 @@
+#ifndef MONO_SLAM_MATCHER_HAMMING_H_
+#define MONO_SLAM_MATCHER_HAMMING_H_
+
+#include <cstddef>  // std::size_t
+#include <cstdint>  // std::uint8_t, std::uint64_t
+#include <cstring>  // std::memcpy
+
+namespace mono_slam {
+
+// Packed 256-bit binary descriptor (e.g. ORB, BRIEF-256).
+struct alignas(32) Desc256 {
+  std::uint64_t words_[4];
+
+  Desc256() = default;
+  explicit Desc256(const std::uint8_t* data) { std::memcpy(words_, data, 32); }
+
+  inline const std::uint8_t* data() const {
+    return reinterpret_cast<const std::uint8_t*>(words_);
+  }
+};
+
+// Binary descriptor of up to kMaxBytes bytes stored inline and zero-padded,
+// e.g. the representative descriptor of a map point whichever binary
+// descriptor is extracted. \sa BinaryDescriptor.
+//! Thanks to the padding, distances could be computed on the full kMaxBytes
+//! bytes whatever the actual length is.
+struct alignas(32) DescBuffer {
+  static constexpr int kMaxBytes = 64;  // Up to 512 bits.
+
+  std::uint8_t bytes_[kMaxBytes];
+
+  DescBuffer() = default;
+  DescBuffer(const std::uint8_t* data, const int n_bytes) {
+    std::memcpy(bytes_, data, n_bytes);
+    std::memset(bytes_ + n_bytes, 0, kMaxBytes - n_bytes);
+  }
+
+  inline const std::uint8_t* data() const { return bytes_; }
+};
+
+//! Hamming distance kernels for 256-bit descriptors. The fastest kernel
+//! supported by the running CPU (AVX-512 VPOPCNTDQ, AVX2, POPCNT or the
+//! portable bit-twiddling fallback) is selected once at the first call.
+//! Descriptors are passed as raw pointers to 32 bytes. Strides are in bytes,
+//! e.g. cv::Mat::step of a descriptor matrix having one descriptor per row.
+namespace hamming {
+
+// Distance between two descriptors.
+int distance(const std::uint8_t* desc_1, const std::uint8_t* desc_2);
+
+inline int distance(const Desc256& desc_1, const Desc256& desc_2) {
+  return distance(desc_1.data(), desc_2.data());
+}
+
+// Distances between the query descriptor and n_train consecutive train
+// descriptors, such that dists[i] = dist(query, train + i * train_stride).
+void distanceOneToMany(const std::uint8_t* query, const std::uint8_t* train,
+                       const std::size_t train_stride, const int n_train,
+                       int* dists);
+
+// Same as above but only against the train descriptors selected by indices,
+// such that dists[i] = dist(query, train + indices[i] * train_stride).
+void distanceOneToIndexed(const std::uint8_t* query,
+                          const std::uint8_t* train,
+                          const std::size_t train_stride, const int* indices,
+                          const int n_indices, int* dists);
+
+// Pairwise distances stored row-major such that
+// dists[i * n_train + j] = dist(query_i, train_j).
+void distanceManyToMany(const std::uint8_t* query,
+                        const std::size_t query_stride, const int n_query,
+                        const std::uint8_t* train,
+                        const std::size_t train_stride, const int n_train,
+                        int* dists);
+
+// Name of the selected kernel. Used for logging.
+const char* kernelName();
+
+// Population count of a 64-bit word.
+inline int popcount64(std::uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(v);
+#else
+  //@ref http://graphics.stanford.edu/~seander/bithacks.html
+  v = v - ((v >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Distance between two descriptors of kBytes bytes, for lengths without a
+// dedicated kernel. The length is known at compile time, hence the loops are
+// fully unrolled and vectorized where the target allows.
+template <int kBytes>
+inline int distanceFixed(const std::uint8_t* desc_1,
+                         const std::uint8_t* desc_2) {
+  constexpr int kNumWords = kBytes / 8;
+  int dist = 0;
+  for (int i = 0; i < kNumWords; ++i) {
+    std::uint64_t a, b;
+    std::memcpy(&a, desc_1 + 8 * i, 8);
+    std::memcpy(&b, desc_2 + 8 * i, 8);
+    dist += popcount64(a ^ b);
+  }
+  // Remaining bytes if the length is not a multiple of 8.
+  for (int i = 8 * kNumWords; i < kBytes; ++i)
+    dist += popcount64(desc_1[i] ^ desc_2[i]);
+  return dist;
+}
+
+}  // namespace hamming
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_MATCHER_HAMMING_H_
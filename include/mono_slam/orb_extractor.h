@@ -0,0 +1,88 @@
+#ifndef MONO_SLAM_ORB_EXTRACTOR_H_
+#define MONO_SLAM_ORB_EXTRACTOR_H_
+
+#include "mono_slam/common_include.h"
+#include "mono_slam/utils/thread_pool.h"
+
+namespace mono_slam {
+
+// ORB extractor detecting well distributed keypoints.
+//! Each pyramid level is split into cells in which FAST is run with an initial
+//! threshold and, if nothing is detected, again with a lower one, so that
+//! textureless regions still contribute keypoints. Keypoints of each level are
+//! then distributed with a quadtree to retain at most the level's share of the
+//! feature budget. Cells and levels are processed in parallel on a thread pool.
+//! The descriptors are computed by OpenCV's ORB to stay compatible with the
+//! pretrained vocabulary.
+class ORBExtractor {
+ public:
+  using Ptr = uptr<ORBExtractor>;
+
+  ORBExtractor(const int n_feats, const double scale_factor,
+               const int n_levels, const int fast_thresh_init,
+               const int fast_thresh_min, const int cell_size,
+               const int n_threads);
+
+  // Detect keypoints and compute descriptors on a grayscale image. Keypoints
+  // are expressed in the coordinates of level 0 and octave is set as the
+  // pyramid level they were detected at.
+  void detectAndCompute(const cv::Mat& img_gray, vector<cv::KeyPoint>& kpts,
+                        cv::Mat& descriptors);
+
+  // Image pyramid built during the last detectAndCompute. The levels are not
+  // reused by later calls, hence could be shared safely.
+  inline const vector<cv::Mat>& pyramid() const { return pyramid_; }
+
+ private:
+  // Build image pyramid by successively resizing the previous level.
+  void buildPyramid(const cv::Mat& img_gray);
+
+  // Run FAST on the cells of the row_th row of cells on level.
+  void detectInCellRow(const int level, const int row,
+                       vector<cv::KeyPoint>& kpts) const;
+
+  // Distribute and orient the keypoints of the level and compute their
+  // descriptors.
+  void processLevel(const int level, vector<cv::KeyPoint>& kpts,
+                    cv::Mat& descriptors) const;
+
+  // Keypoints are only detected within these borders such that the
+  // descriptor patch always lies inside the image.
+  static constexpr int kEdgeThresh = 19;
+  static constexpr int kPatchSize = 31;
+  static constexpr int kHalfPatchSize = 15;
+
+  const int n_feats_;
+  const int n_levels_;
+  const int fast_thresh_init_;
+  const int fast_thresh_min_;
+  const int cell_size_;
+  vector<double> scale_factors_;
+  vector<int> n_feats_per_level_;  // Share of the budget of each level.
+  vector<int> umax_;  // Half width of each row of the circular patch.
+
+  vector<cv::Mat> pyramid_;
+  //! One descriptor extractor per level such that levels could be computed
+  //! concurrently.
+  vector<cv::Ptr<cv::ORB>> descriptor_extractors_;
+  ThreadPool::Ptr thread_pool_ = nullptr;
+};
+
+namespace orb_utils {
+
+// Retain at most n_desired keypoints well distributed over the region
+// [min_x, max_x) x [min_y, max_y) by recursively splitting the region into
+// quadrants and keeping the keypoint with the highest response of each leaf.
+vector<cv::KeyPoint> distributeQuadtree(const vector<cv::KeyPoint>& kpts,
+                                        const float min_x, const float max_x,
+                                        const float min_y, const float max_y,
+                                        const int n_desired);
+
+// Orientation of keypoint computed by intensity centroid.
+float computeOrientation(const cv::Mat& img, const cv::Point2f& pt,
+                         const vector<int>& umax);
+
+}  // namespace orb_utils
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_ORB_EXTRACTOR_H_
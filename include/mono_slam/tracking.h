@@ -7,7 +7,9 @@
 #include "mono_slam/initialization.h"
 #include "mono_slam/local_mapping.h"
 #include "mono_slam/map.h"
+#include "mono_slam/orb_extractor.h"
 #include "mono_slam/system.h"
+#include "mono_slam/utils/thread_pool.h"
 #include "mono_slam/viewer.h"
 
 using DBoW3::Vocabulary;
@@ -50,8 +52,15 @@ class Tracking : public std::enable_shared_from_this<Tracking> {
   Tracking();
 
   // Entry function.
+  //! Frames are preprocessed, i.e. features are extracted, on a dedicated
+  //! thread while previous frames are being tracked. Hence the frame created
+  //! from img is tracked only after Config::pipeline_depth() more images are
+  //! added or flush() is called.
   void addImage(const cv::Mat& img);
 
+  // Track all frames remaining in the preprocessing pipeline.
+  void flush();
+
   // Setters.
   void setSystem(sptr<System> system);
   void setLocalMapper(sptr<LocalMapping> local_mapper);
@@ -61,13 +70,22 @@ class Tracking : public std::enable_shared_from_this<Tracking> {
   void reset();
 
  private:
-  // FIXME Due to errors involved with shared_from_this(), I have to move these
-  // two methods from Frame to Tracking.
+  // Create a frame from the image and extract its features. Run on the
+  // preprocessing thread.
+  Frame::Ptr preprocess(const cv::Mat& img);
+
+  // Track a preprocessed frame and update motion model.
+  void track(const Frame::Ptr& frame);
+
+  // FIXME Due to errors involved with shared_from_this(), I have to move this
+  // method from Frame to Tracking.
   // Extract features and compute corresponding descriptors.
-  void extractFeatures();
+  void extractFeatures(const Frame::Ptr& frame);
 
-  // Compute bag of words representation.
-  void computeBoW();
+  // Replace the features of frame by the keypoints, undistorted in place, and
+  // their descriptors.
+  void setFeatures(const Frame::Ptr& frame, vector<cv::KeyPoint>& kpts,
+                   const cv::Mat& descriptors);
 
   // Track current frame.
   void trackCurrentFrame();
@@ -78,6 +96,12 @@ class Tracking : public std::enable_shared_from_this<Tracking> {
   // Track current frame from last frame assuming contant velocity model.
   bool trackFromLastFrame();
 
+  // Track current frame by propagating the observations of last frame with
+  // optical flow, used in place of feature extraction and matching for frames
+  // not due to become keyframes. Return false if the frame is to be tracked by
+  // descriptor matching instead.
+  bool trackFromOpticalFlow();
+
   // Track local map to make the tracking more robust.
   bool trackFromLocalMap();
 
@@ -90,10 +114,18 @@ class Tracking : public std::enable_shared_from_this<Tracking> {
   // Relocalize if tracking is lost.
   bool relocalization();
 
+  // Relocalize by matching the features against all map points through the
+  // descriptor index. Used if no relocalization candidate keyframe succeeds.
+  bool relocalizeAgainstMap();
+
  private:
-  sptr<LocalMapping> local_mapper_ = nullptr;        // Local mapper.
-  sptr<Viewer> viewer_ = nullptr;                    // Viewer.
-  cv::Ptr<cv::FeatureDetector> detector_ = nullptr;  // Feature detector.
+  sptr<LocalMapping> local_mapper_ = nullptr;  // Local mapper.
+  sptr<Viewer> viewer_ = nullptr;              // Viewer.
+  ORBExtractor::Ptr extractor_ = nullptr;      // Feature extractor.
+  //! A single thread such that frames are created and preprocessed in order.
+  ThreadPool::Ptr preprocessor_ = nullptr;
+  // Frames being preprocessed in the order they will be tracked.
+  std::deque<std::future<Frame::Ptr>> pending_frames_;
 };
 
 }  // namespace mono_slam
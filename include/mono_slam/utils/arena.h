@@ -0,0 +1,87 @@
+#ifndef MONO_SLAM_UTILS_ARENA_H_
+#define MONO_SLAM_UTILS_ARENA_H_
+
+#include <cstddef>  // std::size_t
+#include <memory>
+#include <vector>
+
+namespace mono_slam {
+
+// Bump allocator handing out memory from large blocks which are all released
+// at once when the arena is destroyed.
+//! Blocks of the standard size are recycled through a process-wide pool, hence
+//! arenas created and destroyed once per frame rarely hit the system allocator.
+//! An arena is meant to be filled by a single thread; destroying it from any
+//! thread is fine.
+class Arena {
+ public:
+  using Ptr = std::shared_ptr<Arena>;
+
+  // Sized such that the descriptors of a frame, e.g. 2000 x 32 bytes, fit in
+  // a pooled block.
+  static constexpr std::size_t kBlockSize = 256 * 1024;
+  // Requests larger than this get a dedicated block from the system.
+  static constexpr std::size_t kMaxPooledSize = kBlockSize / 2;
+
+  Arena() = default;
+
+  // Return the blocks to the pool.
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Allocate n_bytes aligned to alignment which must be a power of 2.
+  void* allocate(const std::size_t n_bytes, const std::size_t alignment);
+
+ private:
+  struct Block {
+    char* data;
+    std::size_t size;
+  };
+
+  std::vector<Block> blocks_;
+  char* curr_ = nullptr;  // Next free byte of the current block.
+  char* end_ = nullptr;   // End of the current block.
+};
+
+// STL-style allocator allocating from an arena. Memory is only released when
+// the arena dies, which is kept alive by every copy of the allocator. Hence
+// objects created by std::allocate_shared with this allocator keep their arena
+// alive.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena::Ptr arena) : arena_(std::move(arena)) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+  T* allocate(const std::size_t n) {
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  // Released in bulk with the arena.
+  void deallocate(T*, std::size_t) noexcept {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena_;
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.arena_;
+  }
+
+ private:
+  template <typename U>
+  friend class ArenaAllocator;
+
+  Arena::Ptr arena_;
+};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_UTILS_ARENA_H_
@@ -0,0 +1,62 @@
+#ifndef MONO_SLAM_UTILS_EPOCH_H_
+#define MONO_SLAM_UTILS_EPOCH_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>  // std::uint64_t
+
+namespace mono_slam {
+
+// Epoch-based tracking of readers, telling when objects removed from a shared
+// structure are no longer accessed by any reader and could be reclaimed.
+//! A reader pins the current epoch for the duration of an access. An object
+//! retired in epoch r, i.e. removed while the epoch was r, may only be seen by
+//! readers having pinned an epoch not after r. Hence it's reclaimed once the
+//! epoch has advanced past r and all readers pinning r or earlier are done.
+class EpochManager {
+ public:
+  // Maximum number of readers pinning at the same time.
+  static constexpr int kMaxNumReaders = 8;
+
+  // Pinned epoch released when destroyed.
+  class Guard {
+   public:
+    Guard(Guard&& other) noexcept : slot_(other.slot_) {
+      other.slot_ = nullptr;
+    }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+    Guard& operator=(Guard&&) = delete;
+
+    ~Guard() {
+      if (slot_) slot_->store(0);
+    }
+
+   private:
+    friend class EpochManager;
+    explicit Guard(std::atomic<std::uint64_t>* slot) : slot_(slot) {}
+
+    std::atomic<std::uint64_t>* slot_;
+  };
+
+  EpochManager();
+
+  // Pin the current epoch till the guard dies.
+  Guard pin();
+
+  // Epoch in which objects are being retired.
+  inline std::uint64_t epoch() const { return epoch_.load(); }
+
+  // Start a new epoch and return the safe epoch: objects retired in epochs
+  // before it are not accessed by any reader.
+  std::uint64_t advance();
+
+ private:
+  std::atomic<std::uint64_t> epoch_;
+  // Epoch pinned by each reader, 0 if free.
+  std::array<std::atomic<std::uint64_t>, kMaxNumReaders> pinned_;
+};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_UTILS_EPOCH_H_
@@ -0,0 +1,68 @@
+#ifndef MONO_SLAM_UTILS_ID_SCRATCH_H_
+#define MONO_SLAM_UTILS_ID_SCRATCH_H_
+
+#include <algorithm>  // std::fill, std::max
+#include <cstdint>    // std::uint8_t
+#include <vector>
+
+namespace mono_slam {
+
+// Query-local scratch values keyed by dense ids, e.g. Frame::id_ or
+// MapPoint::id_, used in place of temporary markers stored in the objects
+// themselves such that concurrent queries do not interfere.
+//! Each entry is stamped with the generation it was written in, hence reset()
+//! invalidates all entries in O(1) and the storage is reused across queries.
+//! An instance is meant to be used by a single thread, typically declared
+//! thread_local and reset at the start of each query.
+template <typename T>
+class IdScratch {
+ public:
+  explicit IdScratch(const T& init = T()) : init_(init) {}
+
+  // Invalidate all entries.
+  void reset() {
+    if (++generation_ == 0) {  // Wrapped around.
+      std::fill(stamps_.begin(), stamps_.end(), 0u);
+      generation_ = 1;
+    }
+  }
+
+  // Is there an entry for id since the last reset?
+  inline bool contains(const int id) const {
+    return id < static_cast<int>(stamps_.size()) && stamps_[id] == generation_;
+  }
+
+  // Entry of id, created with the initial value if not existing.
+  T& operator[](const int id) {
+    insert(id);
+    return values_[id];
+  }
+
+  // Create the entry of id with the initial value. Return false if it exists
+  // already.
+  bool insert(const int id) {
+    if (id >= static_cast<int>(stamps_.size())) {
+      const std::size_t size =
+          std::max<std::size_t>(id + 1, 2 * stamps_.size());
+      stamps_.resize(size, 0u);
+      values_.resize(size, init_);
+    }
+    if (stamps_[id] == generation_) return false;
+    stamps_[id] = generation_;
+    values_[id] = init_;
+    return true;
+  }
+
+ private:
+  std::vector<unsigned> stamps_;  // Generation each entry was written in.
+  std::vector<T> values_;
+  unsigned generation_ = 1;  //! Stamp 0 is never valid.
+  const T init_;
+};
+
+// Set of ids visited by a query.
+using IdSet = IdScratch<std::uint8_t>;
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_UTILS_ID_SCRATCH_H_
@@ -0,0 +1,172 @@
+#ifndef MONO_SLAM_UTILS_SLOT_VECTOR_H_
+#define MONO_SLAM_UTILS_SLOT_VECTOR_H_
+
+#include <algorithm>  // std::max, std::min
+#include <cstdint>    // std::uint8_t
+#include <memory>     // std::shared_ptr
+#include <utility>    // std::move
+#include <vector>
+
+namespace mono_slam {
+
+// Values keyed by dense ids, e.g. Frame::id_ or MapPoint::id_, supporting O(1)
+// insertion, removal and lookup by id while keeping the values packed in a
+// contiguous array for fast iteration and copying.
+//! Values are stored densely and a removed value is replaced by the last one,
+//! hence the order of iteration is not the order of insertion. Ids are the
+//! stable handles of values: positions of values change as others are
+//! removed.
+//! Immutable snapshots of the values are taken by snapshot(), splitting the
+//! packed array into chunks of kChunkSize values shared by consecutive
+//! snapshots: only the chunks changed since the last snapshot are copied.
+template <typename T, int kChunkSize = 256>
+class SlotVector {
+ public:
+  using const_iterator = typename std::vector<T>::const_iterator;
+  using Chunk = std::vector<T>;
+  using ChunkPtr = std::shared_ptr<const Chunk>;
+
+  // Immutable copy of the values, cheap to take and to pass around.
+  class Snapshot {
+   public:
+    inline int size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+
+    // Call fn(value) for each value, in the order of the packed array.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+      for (const ChunkPtr& chunk : chunks_)
+        for (const T& value : *chunk) fn(value);
+    }
+
+    std::vector<T> values() const {
+      std::vector<T> values;
+      values.reserve(size_);
+      for (const ChunkPtr& chunk : chunks_)
+        values.insert(values.end(), chunk->cbegin(), chunk->cend());
+      return values;
+    }
+
+   private:
+    friend class SlotVector;
+
+    std::vector<ChunkPtr> chunks_;
+    int size_ = 0;
+  };
+
+  // Insert the value keyed by id. Return false if there's a value with the id
+  // already.
+  bool insert(const int id, T value) {
+    if (id >= static_cast<int>(pos_of_id_.size()))
+      pos_of_id_.resize(std::max<std::size_t>(id + 1, 2 * pos_of_id_.size()),
+                        -1);
+    if (pos_of_id_[id] >= 0) return false;
+    pos_of_id_[id] = values_.size();
+    markDirty(values_.size());
+    values_.push_back(std::move(value));
+    ids_.push_back(id);
+    return true;
+  }
+
+  // Remove the value keyed by id. Return false if there's no such value.
+  bool erase(const int id) {
+    if (!contains(id)) return false;
+    eraseAt(pos_of_id_[id]);
+    return true;
+  }
+
+  // Remove all values satisfying pred in a single pass. Return the number of
+  // values removed.
+  template <typename Pred>
+  int eraseIf(Pred pred) {
+    int n_erased = 0;
+    for (int pos = 0; pos < static_cast<int>(values_.size());) {
+      if (pred(values_[pos])) {
+        eraseAt(pos);  // The last value is moved to pos, not yet tested.
+        ++n_erased;
+      } else
+        ++pos;
+    }
+    return n_erased;
+  }
+
+  inline bool contains(const int id) const {
+    return id >= 0 && id < static_cast<int>(pos_of_id_.size()) &&
+           pos_of_id_[id] >= 0;
+  }
+
+  void clear() {
+    values_.clear();
+    ids_.clear();
+    pos_of_id_.clear();
+    chunks_.clear();
+    is_dirty_.clear();
+    dirty_chunks_.clear();
+  }
+
+  // Snapshot of the current values, copying only the chunks changed since the
+  // last snapshot.
+  Snapshot snapshot() {
+    const int n_chunks = (values_.size() + kChunkSize - 1) / kChunkSize;
+    chunks_.resize(n_chunks);
+    for (const int c : dirty_chunks_) {
+      is_dirty_[c] = 0;
+      if (c >= n_chunks) continue;  // Shrunk since.
+      const int first = c * kChunkSize;
+      const int last = std::min<int>(first + kChunkSize, values_.size());
+      chunks_[c] = std::make_shared<const Chunk>(values_.cbegin() + first,
+                                                 values_.cbegin() + last);
+    }
+    dirty_chunks_.clear();
+    Snapshot snapshot;
+    snapshot.chunks_ = chunks_;
+    snapshot.size_ = values_.size();
+    return snapshot;
+  }
+
+  inline int size() const { return static_cast<int>(values_.size()); }
+  inline bool empty() const { return values_.empty(); }
+
+  // The packed values, e.g. for taking a snapshot by copy.
+  inline const std::vector<T>& values() const { return values_; }
+
+  inline const_iterator begin() const { return values_.cbegin(); }
+  inline const_iterator end() const { return values_.cend(); }
+
+ private:
+  void eraseAt(const int pos) {
+    const int last = values_.size() - 1;
+    markDirty(pos);
+    markDirty(last);
+    pos_of_id_[ids_[pos]] = -1;
+    if (pos != last) {
+      values_[pos] = std::move(values_[last]);
+      ids_[pos] = ids_[last];
+      pos_of_id_[ids_[pos]] = pos;
+    }
+    values_.pop_back();
+    ids_.pop_back();
+  }
+
+  // Mark the chunk holding the value at pos as changed.
+  void markDirty(const int pos) {
+    const int c = pos / kChunkSize;
+    if (c >= static_cast<int>(is_dirty_.size())) is_dirty_.resize(c + 1, 0);
+    if (is_dirty_[c]) return;
+    is_dirty_[c] = 1;
+    dirty_chunks_.push_back(c);
+  }
+
+  std::vector<T> values_;  // Packed values.
+  std::vector<int> ids_;   // Id of each value.
+  // Position in values_ of each id, -1 if none.
+  std::vector<int> pos_of_id_;
+  // Chunks of the last snapshot and those changed since.
+  std::vector<ChunkPtr> chunks_;
+  std::vector<std::uint8_t> is_dirty_;
+  std::vector<int> dirty_chunks_;
+};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_UTILS_SLOT_VECTOR_H_
@@ -0,0 +1,64 @@
+#ifndef MONO_SLAM_UTILS_THREAD_POOL_H_
+#define MONO_SLAM_UTILS_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace mono_slam {
+
+// Fixed-size pool of worker threads consuming tasks in FIFO order.
+class ThreadPool {
+ public:
+  using Ptr = std::unique_ptr<ThreadPool>;
+
+  explicit ThreadPool(const int n_threads);
+
+  // Join all workers after the pending tasks are done.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  inline int size() const { return static_cast<int>(workers_.size()); }
+
+  // Enqueue a task and get a future holding its result.
+  template <typename F>
+  auto enqueue(F&& f) -> std::future<std::invoke_result_t<F>> {
+    using R = std::invoke_result_t<F>;
+    //! packaged_task is move-only whilst std::function requires copyable
+    //! callables, hence shared_ptr.
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mut_);
+      tasks_.emplace([task]() { (*task)(); });
+    }
+    cond_var_.notify_one();
+    return result;
+  }
+
+  // Run fn(i) for i in [begin, end) on the workers and the calling thread and
+  // block till all are done. Exceptions thrown by fn are rethrown here.
+  void parallelFor(const int begin, const int end,
+                   const std::function<void(int)>& fn);
+
+ private:
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mut_;
+  std::condition_variable cond_var_;
+  bool is_stopping_;
+};
+
+}  // namespace mono_slam
+
+#endif  // MONO_SLAM_UTILS_THREAD_POOL_H_
@@ -47,7 +47,8 @@ class Viewer {
 
   Frame::Ptr last_frame_{nullptr};
   Frame::Ptr curr_frame_{nullptr};
-  list<MapPoint::Ptr> points_;
+  // Snapshot of the map taken with the frames.
+  MapSnapshot::Ptr map_snapshot_{nullptr};
 
   viewer_utils::PclViewer::Ptr pcl_viewer_{nullptr};  // Pcl viewer.
 
@@ -4,6 +4,24 @@ namespace mono_slam {
 
 Camera::Camera() {}
 
+void Camera::initUndistortMap(const cv::Size& img_size) {
+  undist_map_.release();
+  if (dist_coeffs_(0) == 0) return;  // If having no distortion.
+  // Undistort all pixels at once with the iterative solver.
+  cv::Mat pts(img_size.height * img_size.width, 1, CV_32FC2);
+  float* data = pts.ptr<float>(0);
+  for (int r = 0; r < img_size.height; ++r)
+    for (int c = 0; c < img_size.width; ++c) {
+      *data++ = c;
+      *data++ = r;
+    }
+  cv::Mat K, dist_coeffs;
+  cv::eigen2cv(K_, K);
+  cv::eigen2cv(dist_coeffs_, dist_coeffs);
+  cv::undistortPoints(pts, pts, K, dist_coeffs, cv::Mat{}, K);
+  undist_map_ = pts.reshape(2, img_size.height);
+}
+
 // Setters.
 void Camera::setPose(const SE3& T_c_w) { T_c_w_ = T_c_w; }
 void Camera::setPos(const Vec3& pos) { T_c_w_.translation() = pos; }
@@ -1,7 +1,8 @@
 #include "mono_slam/config.h"
 
-#include <algorithm>  // std::transform
+#include <algorithm>  // std::transform, std::max
 #include <numeric>    // std::iota
+#include <thread>     // std::thread::hardware_concurrency
 #include <cmath>      // std::pow
 
 namespace mono_slam {
@@ -9,6 +10,18 @@ namespace mono_slam {
 Config::Config()
     : max_n_feats_(2000),
       min_n_feats_(100),
+      n_matcher_threads_(
+          std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)),
+      n_mapper_threads_(
+          std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)),
+      retain_color_imgs_(false),
+      dataset_n_prefetch_(8),
+      dataset_n_decode_threads_(2),
+      pipeline_depth_(1),
+      use_klt_tracking_(false),
+      klt_win_size_(21),
+      klt_n_levels_(3),
+      klt_min_n_inlier_matches_(50),
       min_n_matches_(10),
       min_n_inlier_matches_(10),
       init_min_n_feats_(130),
@@ -23,10 +36,17 @@ Config::Config()
       match_thresh_relax_(100),
       match_thresh_strict_(50),
       search_radius_(100),
+      grid_n_cols_(64),
+      grid_n_rows_(48),
       search_view_dir_factor_low_(2.5),
       search_view_dir_factor_high_(4.0),
       scale_factor_(1.2),
       scale_n_levels_(8),
+      fast_thresh_init_(20),
+      fast_thresh_min_(7),
+      extractor_cell_size_(30),
+      n_extractor_threads_(
+          std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)),
       dist_ratio_test_factor_(0.8),
       redun_factor_(0.9),
       weight_factor_(0.8),
@@ -0,0 +1,212 @@
+#include "mono_slam/covisibility_graph.h"
+
+#include "mono_slam/config.h"
+#include "mono_slam/utils/id_scratch.h"
+
+namespace mono_slam {
+
+void CovisibilityGraph::addKeyframe(const Frame::Ptr& keyframe) {
+  // Count the map points shared with each keyframe observing any of the map
+  // points of this keyframe, outside the lock since only snapshots of the
+  // observations are read.
+  //! Only the map points having got the observation of this keyframe are
+  //! counted, each once, matching what erasePoint() decrements later.
+  thread_local IdScratch<int> weights(0);
+  thread_local IdSet is_counted;  // Map point counted already?
+  weights.reset();
+  is_counted.reset();
+  vector<int> ids, co_ids;
+  for (const Feature::Ptr& feat : keyframe->feats_) {
+    if (!feat) continue;
+    const MapPoint::Ptr point = feat->point_.lock();
+    if (!point || !is_counted.insert(point->id_)) continue;
+    gatherObservers(point, ids);
+    if (std::find(ids.cbegin(), ids.cend(), keyframe->id_) == ids.cend())
+      continue;
+    for (const int id : ids) {
+      if (id == keyframe->id_) continue;  // Self is excluded.
+      if (weights[id]++ == 0) co_ids.push_back(id);
+    }
+  }
+
+  lock_g lock(mut_);
+  Node& node = nodes_[keyframe->id_];
+  if (node.kf) {
+    LOG(WARNING) << "Keyframe being inserted is already in the graph.";
+    return;
+  }
+  node.kf = keyframe;
+  int max_weight = 0;
+  for (const int id : co_ids) {
+    if (!nodes_.count(id)) continue;  // Not inserted yet or erased.
+    const int weight = weights[id];
+    addWeight(keyframe->id_, id, weight);
+    // The first found of those sharing the most becomes the parent.
+    if (weight > max_weight) {
+      max_weight = weight;
+      node.parent = id;
+    }
+  }
+  if (node.parent >= 0)
+    nodes_.at(node.parent).children.push_back(keyframe->id_);
+  LOG(INFO) << cv::format("Keyframe %d now has %lu covisible keyframes.",
+                          keyframe->id_, node.edges.size());
+}
+
+void CovisibilityGraph::eraseKeyframe(const Frame::Ptr& keyframe) {
+  lock_g lock(mut_);
+  auto it = nodes_.find(keyframe->id_);
+  if (it == nodes_.end()) return;
+  Node& node = it->second;
+
+  // Unlink from the neighbours.
+  for (const Edge& edge : node.edges)
+    addWeightTo(nodes_.at(edge.id), keyframe->id_, -edge.weight);
+
+  // Hand over the children to the parent.
+  //! A child of a root becomes a root as well.
+  if (node.parent >= 0) {
+    vector<int>& siblings = nodes_.at(node.parent).children;
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), it->first),
+                   siblings.end());
+    siblings.insert(siblings.end(), node.children.cbegin(),
+                    node.children.cend());
+  }
+  for (const int id : node.children) nodes_.at(id).parent = node.parent;
+  nodes_.erase(it);
+}
+
+void CovisibilityGraph::addObservation(const MapPoint::Ptr& point,
+                                       const Frame::Ptr& keyframe) {
+  vector<int> ids;
+  lock_g lock(mut_);
+  if (!nodes_.count(keyframe->id_)) return;
+  gatherObservers(point, ids);
+  for (const int id : ids)
+    if (id != keyframe->id_) addWeight(keyframe->id_, id, 1);
+}
+
+void CovisibilityGraph::eraseObservation(const MapPoint::Ptr& point,
+                                         const Frame::Ptr& keyframe) {
+  vector<int> ids;
+  lock_g lock(mut_);
+  if (!nodes_.count(keyframe->id_)) return;
+  gatherObservers(point, ids);
+  for (const int id : ids)
+    if (id != keyframe->id_) addWeight(keyframe->id_, id, -1);
+}
+
+void CovisibilityGraph::erasePoint(const MapPoint::Ptr& point) {
+  vector<int> ids;
+  lock_g lock(mut_);
+  gatherObservers(point, ids);
+  const int n_ids = ids.size();
+  for (int i = 0; i < n_ids; ++i)
+    for (int j = i + 1; j < n_ids; ++j) addWeight(ids[i], ids[j], -1);
+}
+
+CovisibilityGraph::View CovisibilityGraph::getCoKfs(const Frame::Ptr& keyframe,
+                                                    const int n) const {
+  lock_g lock(mut_);
+  auto it = nodes_.find(keyframe->id_);
+  if (it == nodes_.end()) return View();
+  const Node& node = it->second;
+  if (!node.sorted) {
+    // Filter out those keyframes that the number of shared map points below
+    // certain threshold, then rank the rest by decreasing weight.
+    vector<Edge> edges;
+    edges.reserve(node.edges.size());
+    for (const Edge& edge : node.edges)
+      if (edge.weight > Config::co_kf_weight_thresh()) edges.push_back(edge);
+    //! Ties are broken by ids such that the ranking is deterministic.
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+      return a.weight > b.weight || (a.weight == b.weight && a.id < b.id);
+    });
+    auto sorted = make_shared<vector<Frame::Ptr>>();
+    sorted->reserve(edges.size());
+    for (const Edge& edge : edges) sorted->push_back(nodes_.at(edge.id).kf);
+    node.sorted = std::move(sorted);
+  }
+  return View(node.sorted, n);
+}
+
+int CovisibilityGraph::getWeight(const Frame::Ptr& kf_1,
+                                 const Frame::Ptr& kf_2) const {
+  lock_g lock(mut_);
+  auto it = nodes_.find(kf_1->id_);
+  if (it == nodes_.end()) return 0;
+  const Node& node = it->second;
+  auto it_edge = node.edge_of.find(kf_2->id_);
+  if (it_edge == node.edge_of.end()) return 0;
+  return node.edges[it_edge->second].weight;
+}
+
+Frame::Ptr CovisibilityGraph::getParent(const Frame::Ptr& keyframe) const {
+  lock_g lock(mut_);
+  auto it = nodes_.find(keyframe->id_);
+  if (it == nodes_.end() || it->second.parent < 0) return nullptr;
+  return nodes_.at(it->second.parent).kf;
+}
+
+vector<Frame::Ptr> CovisibilityGraph::getChildren(
+    const Frame::Ptr& keyframe) const {
+  lock_g lock(mut_);
+  vector<Frame::Ptr> children;
+  auto it = nodes_.find(keyframe->id_);
+  if (it == nodes_.end()) return children;
+  children.reserve(it->second.children.size());
+  for (const int id : it->second.children)
+    children.push_back(nodes_.at(id).kf);
+  return children;
+}
+
+void CovisibilityGraph::clear() {
+  lock_g lock(mut_);
+  nodes_.clear();
+}
+
+void CovisibilityGraph::addWeight(const int id_1, const int id_2,
+                                  const int delta) {
+  auto it_1 = nodes_.find(id_1), it_2 = nodes_.find(id_2);
+  if (it_1 == nodes_.end() || it_2 == nodes_.end()) return;
+  addWeightTo(it_1->second, id_2, delta);
+  addWeightTo(it_2->second, id_1, delta);
+}
+
+void CovisibilityGraph::addWeightTo(Node& node, const int id,
+                                    const int delta) {
+  auto it = node.edge_of.find(id);
+  if (it == node.edge_of.end()) {
+    if (delta <= 0) return;
+    node.edge_of[id] = node.edges.size();
+    node.edges.push_back({id, delta});
+  } else {
+    const int pos = it->second;
+    node.edges[pos].weight += delta;
+    if (node.edges[pos].weight <= 0) {
+      // Swap-remove the edge.
+      node.edge_of.erase(it);
+      const int last = node.edges.size() - 1;
+      if (pos != last) {
+        node.edges[pos] = node.edges[last];
+        node.edge_of[node.edges[pos].id] = pos;
+      }
+      node.edges.pop_back();
+    }
+  }
+  node.sorted.reset();  // Sorted again as queried.
+}
+
+void CovisibilityGraph::gatherObservers(const MapPoint::Ptr& point,
+                                        vector<int>& ids) {
+  ids.clear();
+  const MapPoint::ObsSnapshot observations = point->getObservations();
+  ids.reserve(observations->size());
+  for (const Feature::Ptr& feat : *observations) {
+    //! Not feat_utils::getKeyframe() which skips outliers.
+    const Frame::Ptr kf = feat ? feat->frame_.lock() : nullptr;
+    if (kf) ids.push_back(kf->id_);
+  }
+}
+
+}  // namespace mono_slam
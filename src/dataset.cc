@@ -1,5 +1,7 @@
 #include "mono_slam/dataset.h"
 
+#include <algorithm>  // std::max
+
 #include "boost/format.hpp"  // boost::format
 #include "glog/logging.h"
 #include "opencv2/core.hpp"
@@ -9,27 +11,62 @@
 namespace mono_slam {
 
 Dataset::Dataset(const string& dataset_path, const string& img_file_name_fmt,
-                 const double img_resize_factor, const int img_start_idx)
+                 const double img_resize_factor, const int img_start_idx,
+                 const int n_prefetch, const int n_decode_threads)
     : dataset_path_(dataset_path),
       img_file_name_fmt_(img_file_name_fmt),
       img_resize_factor_(img_resize_factor),
-      img_idx_(img_start_idx) {}
+      img_idx_(img_start_idx),
+      prefetch_idx_(img_start_idx),
+      n_prefetch_(std::max(n_prefetch, 1)),
+      is_exhausted_(false) {
+  decode_pool_.reset(new ThreadPool(n_decode_threads));
+  prefetch();
+}
+
+bool Dataset::nextImage(cv::Mat& image) {
+  if (prefetched_images_.empty()) return false;
+  image = prefetched_images_.front().get();
+  prefetched_images_.pop_front();
+  if (image.empty()) {
+    //! Images after the missing one might exist but are never tracked.
+    is_exhausted_ = true;
+    prefetched_images_.clear();
+    LOG(INFO) << "Reached end of sequence at image " << img_idx_;
+    return false;
+  }
+  LOG(INFO) << "Get image " << img_idx_;
+  ++img_idx_;
+  prefetch();
+  return true;
+}
+
+cv::Size Dataset::imageSize() const {
+  const cv::Mat image = loadImage(img_idx_);
+  CHECK_EQ(!image.empty(), true);
+  return image.size();
+}
 
-cv::Mat Dataset::nextImage() {
+cv::Mat Dataset::loadImage(const int img_idx) const {
   boost::format fmt(dataset_path_ + img_file_name_fmt_);
   // boost::format fmt(
   //     "/home/bayes/Documents/monocular_vo/data/dataset/KITTI/seq00/%06d.png");
-  cv::Mat image = cv::imread((fmt % img_idx_).str(),
+  cv::Mat image = cv::imread((fmt % img_idx).str(),
                              cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
-  CHECK_EQ(!image.empty(), true);
+  if (image.empty() || img_resize_factor_ == 1.0) return image;
   cv::Mat resized_image;
-  image.copyTo(resized_image);
-  if (img_resize_factor_ != 1.0)
-    cv::resize(image, resized_image, {}, img_resize_factor_, img_resize_factor_,
-               cv::INTER_AREA);
-  LOG(INFO) << "Get image " << img_idx_;
-  ++img_idx_;
+  cv::resize(image, resized_image, {}, img_resize_factor_, img_resize_factor_,
+             cv::INTER_AREA);
   return resized_image;
 }
 
-}  // namespace mono_slam
\ No newline at end of file
+void Dataset::prefetch() {
+  while (!is_exhausted_ &&
+         static_cast<int>(prefetched_images_.size()) < n_prefetch_) {
+    const int img_idx = prefetch_idx_++;
+    prefetched_images_.push_back(decode_pool_->enqueue(
+        [this, img_idx]() { return loadImage(img_idx); }));
+  }
+}
+
+}  // namespace mono_slam
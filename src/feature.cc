@@ -0,0 +1,18 @@
+#include "mono_slam/feature.h"
+
+#include "mono_slam/frame.h"
+#include "mono_slam/map_point.h"
+
+namespace mono_slam {
+namespace feat_utils {
+
+void linkPoint(const sptr<Feature>& feat, const sptr<MapPoint>& point) {
+  feat->point_ = point;
+  const sptr<Frame> frame = feat->frame_.lock();
+  if (frame) frame->is_linked_[feat->idx_] = (point != nullptr);
+}
+
+void unlinkPoint(const sptr<Feature>& feat) { linkPoint(feat, nullptr); }
+
+}  // namespace feat_utils
+}  // namespace mono_slam
@@ -8,24 +8,60 @@ namespace mono_slam {
 
 int Frame::frame_cnt_ = 0;
 double Frame::x_min_, Frame::x_max_, Frame::y_min_, Frame::y_max_;
+double Frame::grid_cell_width_inv_, Frame::grid_cell_height_inv_;
 
 Frame::Frame(const cv::Mat& img)
     : id_(frame_cnt_++), is_keyframe_(false), is_datum_(false) {
-  img.copyTo(img_);
+  //! img is owned by this frame only, hence no deep copy. Only the grayscale
+  //! image is kept by default; the rest of the pyramid is filled in by feature
+  //! extraction.
+  pyramid_.resize(1);
+  if (img.channels() == 3)
+    cv::cvtColor(img, pyramid_[0], cv::COLOR_BGR2GRAY);
+  else
+    pyramid_[0] = img;
+  if (Config::retain_color_imgs() && img.channels() == 3) img_ = img;
   cam_.reset(new Camera());
-  // TODO(bayes) Optimize when no distortion.
-  // Compute image bounds (computed once in the first frame).
-  if (id_ == 0) {
-    // Matrix containing the four corners of the image:
-    // Left upper, right upper, left bottom, right bottom.
-    cv::Mat corners;
-    frame_utils::computeImageBounds(img, cam_->K(), cam_->distCoeffs(),
-                                    corners);
-    x_min_ = std::min(corners.at<float>(0, 0), corners.at<float>(2, 0));
-    x_max_ = std::max(corners.at<float>(1, 0), corners.at<float>(3, 0));
-    y_min_ = std::min(corners.at<float>(0, 1), corners.at<float>(1, 1));
-    y_max_ = std::max(corners.at<float>(2, 1), corners.at<float>(3, 1));
+}
+
+void Frame::computeBoW(const DBoW3::Vocabulary& voc) {
+  std::call_once(bow_once_, [this, &voc]() {
+    DBoW3::FeatureVector feat_vec;
+    voc.transform(descriptors_, bow_vec_, feat_vec, 4);
+    feat_vec_.assign(feat_vec);
+  });
+}
+
+cv::Mat Frame::imgForDrawing() const {
+  lock_g lock(mut_);
+  if (!img_.empty()) return img_;
+  return pyramid_.empty() ? cv::Mat{} : pyramid_[0];
+}
+
+void Frame::releaseImages() {
+  lock_g lock(mut_);
+  if (is_keyframe_) {
+    pyramid_.resize(std::min(static_cast<int>(pyramid_.size()), 1));
+  } else {
+    pyramid_.clear();
+    img_.release();
   }
+  //! Release the memory held by the vector itself as well.
+  pyramid_.shrink_to_fit();
+}
+
+void Frame::initImageBounds(const cv::Size& img_size) {
+  // Matrix containing the four corners of the image:
+  // Left upper, right upper, left bottom, right bottom.
+  cv::Mat corners;
+  frame_utils::computeImageBounds(img_size, Camera::K_, Camera::dist_coeffs_,
+                                  corners);
+  x_min_ = std::min(corners.at<float>(0, 0), corners.at<float>(2, 0));
+  x_max_ = std::max(corners.at<float>(1, 0), corners.at<float>(3, 0));
+  y_min_ = std::min(corners.at<float>(0, 1), corners.at<float>(1, 1));
+  y_max_ = std::max(corners.at<float>(2, 1), corners.at<float>(3, 1));
+  grid_cell_width_inv_ = Config::grid_n_cols() / (x_max_ - x_min_);
+  grid_cell_height_inv_ = Config::grid_n_rows() / (y_max_ - y_min_);
 }
 
 void Frame::setPose(const SE3& T_c_w) {
@@ -38,104 +74,84 @@ void Frame::setKeyframe() {
   is_keyframe_ = true;
 }
 
-vector<int> Frame::searchFeatures(const Vec2& pt, const int radius,
-                                  int level_low, int level_high) const {
-  level_low = std::clamp(level_low, 0, Config::scale_n_levels());
-  level_high = std::clamp(level_high, 0, Config::scale_n_levels());
-  const int num_obs = this->nObs();
-  vector<int> feat_indices;
-  feat_indices.reserve(num_obs);
-  for (int i = 0; i < num_obs; ++i) {
-    const sptr<Feature>& feat = feats_[i];
-    const Vec2 dist = (feat->pt_ - pt).cwiseAbs();
-    if (dist.x() <= radius && dist.y() <= radius)
-      if (feat->level_ >= level_low && feat->level_ <= level_high)
-        feat_indices.push_back(i);
-  }
-  return feat_indices;
-}
-
-//##############################################################################
-// Covisibility graph related.
-
-void Frame::addConnection(Frame::Ptr keyframe, const int weight) {
-  LOG(INFO) << cv::format("add_connection(add frame: %d, to frame: %d)",
-                          keyframe->id_, id_);
-  bool need_update = false;
-  {
-    lock_g lock(co_mut_);
-    if (!co_kf_weights_.count(keyframe) || co_kf_weights_[keyframe] != weight)
-      need_update = true;
+void Frame::assignFeaturesToGrid() {
+  const int n_cols = Config::grid_n_cols(), n_rows = Config::grid_n_rows();
+  const int n_levels = Config::scale_n_levels();
+  const int n_obs = this->nObs();
+  // Cell of each feature.
+  vector<int> cells(n_obs);
+  grid_offsets_.assign(n_levels * n_rows * n_cols + 1, 0);
+  for (int i = 0; i < n_obs; ++i) {
+    const Vec2& pt = pts_[i];
+    // Features falling out of the bounds (e.g. due to undistortion) are
+    // assigned to the nearest border cells.
+    const int c = std::clamp(
+        static_cast<int>((pt.x() - x_min_) * grid_cell_width_inv_), 0,
+        n_cols - 1);
+    const int r = std::clamp(
+        static_cast<int>((pt.y() - y_min_) * grid_cell_height_inv_), 0,
+        n_rows - 1);
+    const int level = std::clamp(levels_[i], 0, n_levels - 1);
+    cells[i] = (level * n_rows + r) * n_cols + c;
+    ++grid_offsets_[cells[i]];
   }
-  if (need_update) updateCoKfsAndWeights();
-}
 
-void Frame::deleteConnection(const Frame::Ptr& keyframe) {
-  LOG(INFO) << cv::format("delete_connection(delete frame: %d, from frame: %d)",
-                          keyframe->id_, id_);
-  bool need_update = false;
-  {
-    lock_g lock(co_mut_);
-    if (co_kf_weights_.count(keyframe)) {
-      co_kf_weights_.erase(keyframe);
-      need_update = true;
-    }
-  }
-  if (need_update) updateCoKfsAndWeights();
+  // Counting sort of the features by cells: the offsets are first the ends of
+  // the cells, then moved back to the beginnings as the cells are filled.
+  //! Filled backwards such that indices are increasing within each cell.
+  for (int cell = 1, n_cells = grid_offsets_.size(); cell < n_cells; ++cell)
+    grid_offsets_[cell] += grid_offsets_[cell - 1];
+  grid_feats_.resize(n_obs);
+  for (int i = n_obs - 1; i >= 0; --i)
+    grid_feats_[--grid_offsets_[cells[i]]] = i;
 }
 
-void Frame::updateCoKfsAndWeights() {
-  LOG(INFO) << cv::format("update_co_kfs_and_weights(for frame: %d)", id_);
-  lock_g lock(co_mut_);
-  // Filter out those keyframes that the number of shared map points below
-  // certain threshold.
-  // multimap structure is internally sorted.
-  multimap<int, Frame::Ptr> co_weight_kfs;
-  for (auto it = co_kf_weights_.cbegin(), it_end = co_kf_weights_.cend();
-       it != it_end; ++it) {
-    if (it->second <= Config::co_kf_weight_thresh()) continue;
-    co_weight_kfs.insert({it->second, it->first});
-    // FIXME Need to enable shared_from_this() ?
-    it->first->addConnection(shared_from_this(), it->second);
-  }
-
-  // Update covisible informations.
-  co_kfs_.clear();
-  co_weights_.clear();
-  for (auto it = co_weight_kfs.cbegin(), it_end = co_weight_kfs.cend();
-       it != it_end; ++it) {
-    co_kfs_.push_front(it->second);
-    co_weights_.push_front(it->first);
-  }
+vector<int> Frame::searchFeatures(const Vec2& pt, const int radius,
+                                  const int level_low,
+                                  const int level_high) const {
+  vector<int> feat_indices;
+  searchFeatures(pt, radius, level_low, level_high, feat_indices);
+  return feat_indices;
 }
 
-void Frame::updateCoInfo() {
-  LOG(INFO) << cv::format("update_co_info(for frame: %d)", id_);
-  // Covisible keyframe voter with the key being the covisible keyframe and the
-  // weights being the number of shared map points.
-  unordered_map<Frame::Ptr, int> co_kf_weights;
-  // co_kf_weights.reserve(?). //! Don't know how much capacity to be reserved.
-  //! Map does not have a reserve method whilst unordered_map has.
-
-  // Obtain all covisible keyframes (i.e. ones sharing at least one map point).
-  for (const Feature::Ptr& feat_ : feats_) {
-    const MapPoint::Ptr& point = feat_utils::getPoint(feat_);
-    if (!point) continue;
-    for (const Feature::Ptr& feat : point->getObservations()) {
-      const Frame::Ptr& kf = feat_utils::getKeyframe(feat);
-      if (!kf || kf->id_ == id_) continue;  // Self of course is excluded.
-      co_kf_weights[kf]++;
+void Frame::searchFeatures(const Vec2& pt, const int radius, int level_low,
+                           int level_high, vector<int>& feat_indices) const {
+  const int n_cols = Config::grid_n_cols(), n_rows = Config::grid_n_rows();
+  level_low = std::clamp(level_low, 0, Config::scale_n_levels() - 1);
+  level_high = std::clamp(level_high, 0, Config::scale_n_levels() - 1);
+  feat_indices.clear();
+  if (grid_offsets_.empty()) return;
+
+  // Only visit the cells overlapping with the searching window. Like the
+  // features, windows out of the bounds are clamped to the border cells.
+  const int c_min = std::clamp(
+      static_cast<int>(
+          std::floor((pt.x() - radius - x_min_) * grid_cell_width_inv_)),
+      0, n_cols - 1);
+  const int c_max = std::clamp(
+      static_cast<int>(
+          std::floor((pt.x() + radius - x_min_) * grid_cell_width_inv_)),
+      0, n_cols - 1);
+  const int r_min = std::clamp(
+      static_cast<int>(
+          std::floor((pt.y() - radius - y_min_) * grid_cell_height_inv_)),
+      0, n_rows - 1);
+  const int r_max = std::clamp(
+      static_cast<int>(
+          std::floor((pt.y() + radius - y_min_) * grid_cell_height_inv_)),
+      0, n_rows - 1);
+
+  for (int level = level_low; level <= level_high; ++level) {
+    for (int r = r_min; r <= r_max; ++r) {
+      const int row = (level * n_rows + r) * n_cols;
+      const int k_end = grid_offsets_[row + c_max + 1];
+      for (int k = grid_offsets_[row + c_min]; k < k_end; ++k) {
+        const int i = grid_feats_[k];
+        const Vec2 dist = (pts_[i] - pt).cwiseAbs();
+        if (dist.x() <= radius && dist.y() <= radius) feat_indices.push_back(i);
+      }
     }
   }
-  if (co_kf_weights.empty()) return;
-  {
-    lock_g lock(co_mut_);
-    co_kf_weights_ = co_kf_weights;
-  }
-  updateCoKfsAndWeights();
-  LOG(INFO) << "Updated covisible info for keyframe " << id_;
-  LOG(INFO) << cv::format("Keyframe %d now has %lu covisible keyframes.", id_,
-                          co_kf_weights_.size());
 }
 
 double Frame::computeSceneMedianDepth() {
@@ -151,43 +167,10 @@ double Frame::computeSceneMedianDepth() {
   return math_utils::get_median(depths);
 }
 
-bool Frame::isObservable(const sptr<MapPoint>& point, const int level) const {
-  // Test 1: has positive depth.
-  const Vec3& p_w = point->pos();
-  const Vec3 p_c = cam_->world2camera(p_w);
-  if (p_c(2) < 0.) return false;
-  // Test 2: does not go out of image boundary.
-  const Vec2 repr_pt = cam_->camera2pixel(p_c);
-  if (!(repr_pt.x() >= x_min_ && repr_pt.x() <= x_max_ &&
-        repr_pt.y() >= y_min_ && repr_pt.y() <= y_max_))
-    return false;
-  // FIXME Is the logic right?
-  // Test 3: the image pyramid level of the feature is consistent with median
-  // scale at which the point is observed. (i.e. within +- 1).
-  if (!(level >= point->median_view_scale_ - 1 &&
-        level <= point->median_view_scale_ + 1))
-    return false;
-  // Test 4: viewing direction is consistent with mean viewing direction.
-  const double dist = cam_->getDistToCenter(p_w);
-  const double cos_view_dir =
-      (p_w - cam_->getCamCenter()).dot(point->median_view_dir_) / dist;
-  if (cos_view_dir < std::cos(math_utils::degree2radian(60.))) return false;
-
-  // Store the computed result to be used in searching.
-  point->repr_x_ = repr_pt.x();
-  point->repr_y_ = repr_pt.y();
-  point->level_ = level;
-  point->cos_view_dir_ = cos_view_dir;
-  return true;
-}
-
 void Frame::erase() {
   if (id_ == 0) return;  // The first frame is the datum which cannot be erased.
 
-  lock_g lock(co_mut_);
-  // Erase covisibility connections.
-  auto it = co_kf_weights_.cbegin(), it_end = co_kf_weights_.cend();
-  for (; it != it_end; ++it) it->first->deleteConnection(shared_from_this());
+  //! Covisibility connections are erased by Map::removeKeyframe.
 
   // Erase related observations.
   for (const Feature::Ptr& feat : feats_) {
@@ -203,25 +186,29 @@ void Frame::erase() {
 
 namespace frame_utils {
 
-void undistortKeypoints(const Mat33& K, const Vec4& dist_coeffs,
-                        std::vector<cv::KeyPoint>& kpts) {
-  const int num_kpts = kpts.size();
-  cv::Mat kpts_mat(num_kpts, 2, CV_64F);
-  for (int i = 0; i < num_kpts; ++i) {
-    kpts_mat.at<double>(i, 0) = kpts[i].pt.x;
-    kpts_mat.at<double>(i, 1) = kpts[i].pt.y;
-  }
-  cv::Mat K_, dist_coeffs_;
-  cv::eigen2cv(K, K_);
-  cv::eigen2cv(dist_coeffs, dist_coeffs_);
-  cv::undistortPoints(kpts_mat, kpts_mat, K_, dist_coeffs_, cv::Mat{}, K_);
-  for (int i = 0; i < num_kpts; ++i) {
-    kpts[i].pt.x = kpts_mat.at<double>(i, 0);
-    kpts[i].pt.y = kpts_mat.at<double>(i, 1);
+void undistortKeypoints(std::vector<cv::KeyPoint>& kpts) {
+  const cv::Mat& map = Camera::undist_map_;
+  CHECK_GE(map.cols, 2);
+  CHECK_GE(map.rows, 2);
+  const float max_x = map.cols - 1, max_y = map.rows - 1;
+  for (cv::KeyPoint& kpt : kpts) {
+    const float x = std::clamp(kpt.pt.x, 0.f, max_x);
+    const float y = std::clamp(kpt.pt.y, 0.f, max_y);
+    const int x0 = std::min(static_cast<int>(x), map.cols - 2);
+    const int y0 = std::min(static_cast<int>(y), map.rows - 2);
+    const float a_x = x - x0, a_y = y - y0;
+    //! Each pixel is stored as two interleaved floats.
+    const float* row_0 = map.ptr<float>(y0) + 2 * x0;
+    const float* row_1 = map.ptr<float>(y0 + 1) + 2 * x0;
+    for (int k = 0; k < 2; ++k) {
+      const float top = (1.f - a_x) * row_0[k] + a_x * row_0[k + 2];
+      const float bottom = (1.f - a_x) * row_1[k] + a_x * row_1[k + 2];
+      (k == 0 ? kpt.pt.x : kpt.pt.y) = (1.f - a_y) * top + a_y * bottom;
+    }
   }
 }
 
-void computeImageBounds(const cv::Mat& img, const Mat33& K,
+void computeImageBounds(const cv::Size& img_size, const Mat33& K,
                         const Vec4& dist_coeffs, cv::Mat& corners) {
   corners = cv::Mat(4, 2, CV_32F);
   cv::Mat K_, dist_coeffs_;
@@ -229,12 +216,12 @@ void computeImageBounds(const cv::Mat& img, const Mat33& K,
   cv::eigen2cv(dist_coeffs, dist_coeffs_);
   corners.at<float>(0, 0) = 0.0;
   corners.at<float>(0, 1) = 0.0;
-  corners.at<float>(1, 0) = img.cols;
+  corners.at<float>(1, 0) = img_size.width;
   corners.at<float>(1, 1) = 0.0;
   corners.at<float>(2, 0) = 0.0;
-  corners.at<float>(2, 1) = img.rows;
-  corners.at<float>(3, 0) = img.cols;
-  corners.at<float>(3, 1) = img.rows;
+  corners.at<float>(2, 1) = img_size.height;
+  corners.at<float>(3, 0) = img_size.width;
+  corners.at<float>(3, 1) = img_size.height;
   cv::undistortPoints(corners, corners, K_, dist_coeffs_, cv::Mat{}, K_);
 }
 
@@ -7,6 +7,7 @@
 #include "mono_slam/g2o_optimizer/g2o_utils.h"
 #include "mono_slam/map.h"
 #include "mono_slam/map_point.h"
+#include "mono_slam/utils/id_scratch.h"
 
 // FIXME Possible issues may be raised from the codes calling for obtaining
 // references of some objects. Maybe we could trace them to see whether this
@@ -34,7 +35,7 @@ void Optimizer::globalBA(const Map::Ptr& map, const int n_iters) {
   // Edge container used for post-processing.
   list<g2o_types::EdgeContainer> edge_container;
   // Get keyframes whose poses are going to be optimized.
-  const list<Frame::Ptr> kfs = map->getAllKeyframes();
+  const vector<Frame::Ptr> kfs = map->getAllKeyframes();
 
   // Iterate all keyframes in the map.
   int v_id = 0;  // Vertex id.
@@ -43,7 +44,9 @@ void Optimizer::globalBA(const Map::Ptr& map, const int n_iters) {
     kf->v_frame_ = g2o_utils::createG2oVertexFrame(kf, v_id++, kf->is_datum_);
     assert(optimizer.addVertex(kf->v_frame_));  // Asserting for debugging.
     // Iterate all features and linked map points observed by this keyframe.
-    for (const Feature::Ptr& feat : kf->feats_) {
+    const int n_obs = kf->nObs();
+    for (int i = 0; i < n_obs; ++i) {
+      const Feature::Ptr& feat = kf->feats_[i];
       const MapPoint::Ptr& point = feat_utils::getPoint(feat);
       if (!point) continue;
       // Avoid repeat vertex creation since there's visual overlapping among
@@ -56,8 +59,8 @@ void Optimizer::globalBA(const Map::Ptr& map, const int n_iters) {
       // generally produces larger error.
       //! "1. / (1 << level)" to account for the level 0 case.
       auto e_obs = g2o_utils::createG2oEdgeObs(
-          kf->v_frame_, point->v_point_, feat->pt_, kf->cam_->K(),
-          1. / (1 << feat->level_), std::sqrt(chi2_thresh));
+          kf->v_frame_, point->v_point_, kf->pts_[i], kf->cam_->K(),
+          1. / (1 << kf->levels_[i]), std::sqrt(chi2_thresh));
       assert(optimizer.addEdge(e_obs));
       edge_container.emplace_back(e_obs, kf, feat);
     }
@@ -117,13 +120,15 @@ int Optimizer::optimizePose(const Frame::Ptr& frame, const int n_iters) {
   assert(optimizer.addVertex(frame->v_frame_));
 
   // Iterate all frame->features->map_points.
-  for (const Feature::Ptr& feat : frame->feats_) {
+  const int n_obs = frame->nObs();
+  for (int i = 0; i < n_obs; ++i) {
+    const Feature::Ptr& feat = frame->feats_[i];
     const MapPoint::Ptr& point = feat_utils::getPoint(feat);
     if (!point) continue;
     // Create g2o pose-only unary edge.
     auto e_pose_only = g2o_utils::createG2oEdgePoseOnly(
-        frame->v_frame_, feat->pt_, point->pos_, frame->cam_->K(),
-        1. / (1 << feat->level_), std::sqrt(chi2_thresh));
+        frame->v_frame_, frame->pts_[i], point->pos_, frame->cam_->K(),
+        1. / (1 << frame->levels_[i]), std::sqrt(chi2_thresh));
     assert(optimizer.addEdge(e_pose_only));
     edge_container.emplace_back(e_pose_only, feat);
   }
@@ -206,10 +211,14 @@ void Optimizer::localBA(const Frame::Ptr& keyframe, const Map::Ptr& map,
   list<g2o_types::EdgeContainer> edge_container;
   // Store the map points to be optimized.
   list<MapPoint::Ptr> points;
-  // Store the keyframes involved in optimization while fixed.
-  list<Frame::Ptr> fixed_kfs;
   // Obtain covisible keyframes which are then going to be optimized.
-  const forward_list<Frame::Ptr> co_kfs = keyframe->getCoKfs();
+  const CovisibilityGraph::View co_kfs = map->co_graph_->getCoKfs(keyframe);
+  // g2o vertices of keyframes and map points keyed by their ids. Kept local to
+  // this optimization rather than in the keyframes and map points.
+  thread_local IdScratch<g2o_types::VertexFrame*> v_frames(nullptr);
+  thread_local IdScratch<g2o_types::VertexPoint*> v_points(nullptr);
+  v_frames.reset();
+  v_points.reset();
 
   // Iterate all covisible keyframes.
   //! The covisible information was updated before.
@@ -217,18 +226,17 @@ void Optimizer::localBA(const Frame::Ptr& keyframe, const Map::Ptr& map,
   for (const Frame::Ptr& kf : co_kfs) {
     // Fixed if it's the datum frame.
     //! The datum frame may not ever be passed into here. (Or never?)
-    kf->v_frame_ = g2o_utils::createG2oVertexFrame(kf, v_id++, kf->is_datum_);
-    assert(optimizer.addVertex(kf->v_frame_));
+    v_frames[kf->id_] =
+        g2o_utils::createG2oVertexFrame(kf, v_id++, kf->is_datum_);
+    assert(optimizer.addVertex(v_frames[kf->id_]));
 
     // Iterate all map points observed by this keyframe.
     for (const Feature::Ptr& feat : kf->feats_) {
       const MapPoint::Ptr& point = feat_utils::getPoint(feat);
       // Avoid repeat point vertex creation.
-      if (!point || point->curr_ba_keyframe_id_ == kf->id_) continue;
-      if (point->curr_ba_keyframe_id_ == kf->id_) continue;
-      point->curr_ba_keyframe_id_ = kf->id_;
-      point->v_point_ = g2o_utils::createG2oVertexPoint(point, v_id++);
-      assert(optimizer.addVertex(point->v_point_));
+      if (!point || v_points.contains(point->id_)) continue;
+      v_points[point->id_] = g2o_utils::createG2oVertexPoint(point, v_id++);
+      assert(optimizer.addVertex(v_points[point->id_]));
       points.push_back(point);
       //! Delay the iteration of observations of each map point to avoid many
       //! repeat comparisons.
@@ -238,19 +246,19 @@ void Optimizer::localBA(const Frame::Ptr& keyframe, const Map::Ptr& map,
 
   // Iterate all local map points and obtain their observations.
   for (const MapPoint::Ptr& point : points) {
-    for (const Feature::Ptr& feat : point->getObservations()) {
+    const MapPoint::ObsSnapshot observations = point->getObservations();
+    for (const Feature::Ptr& feat : *observations) {
       const Frame::Ptr& kf = feat_utils::getKeyframe(feat);
       if (!kf) continue;  // FIXME This should never happen.
-      if (kf->v_frame_ == nullptr) {
+      if (!v_frames.contains(kf->id_)) {
         // If does not have a frame yet, kf is selected as a fixed keyframe.
-        kf->v_frame_ = g2o_utils::createG2oVertexFrame(kf, v_id++, true);
-        assert(optimizer.addVertex(kf->v_frame_));
-        fixed_kfs.push_back(kf);
+        v_frames[kf->id_] = g2o_utils::createG2oVertexFrame(kf, v_id++, true);
+        assert(optimizer.addVertex(v_frames[kf->id_]));
       }
 
       // Creata g2o edge for each valid observation.
       auto e_obs = g2o_utils::createG2oEdgeObs(
-          kf->v_frame_, point->v_point_, feat->pt_, kf->cam_->K(),
+          v_frames[kf->id_], v_points[point->id_], feat->pt_, kf->cam_->K(),
           1. / (1 << feat->level_), std::sqrt(chi2_thresh));
       assert(optimizer.addEdge(e_obs));
       edge_container.emplace_back(e_obs, kf, feat);
@@ -287,19 +295,13 @@ void Optimizer::localBA(const Frame::Ptr& keyframe, const Map::Ptr& map,
 
   // Update structure and motion.
   for (const Frame::Ptr& kf : co_kfs) {
-    const SE3 estimate_(kf->v_frame_->estimate().rotation(),
-                        kf->v_frame_->estimate().translation());
+    const g2o_types::VertexFrame* v_frame = v_frames[kf->id_];
+    const SE3 estimate_(v_frame->estimate().rotation(),
+                        v_frame->estimate().translation());
     kf->setPose(estimate_);
-    kf->v_frame_ = nullptr;
-  }
-  for (const MapPoint::Ptr& point : points) {
-    // FIXME Have no idea why this would happen.
-    if (point->v_point_ == nullptr) continue;
-    point->setPos(point->v_point_->estimate());
-    point->v_point_ = nullptr;
   }
-  // Reset fixed keyframes' temporary g2o frame vertices.
-  for (const Frame::Ptr& kf : fixed_kfs) kf->v_frame_ = nullptr;
+  for (const MapPoint::Ptr& point : points)
+    point->setPos(v_points[point->id_]->estimate());
 
   const steady_clock::time_point t2 = steady_clock::now();
   const double time_span = duration_cast<duration<double>>(t2 - t1).count();
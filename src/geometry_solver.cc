@@ -9,14 +9,10 @@ namespace mono_slam {
 
 void GeometrySolver::findFundamentalRansac(
     const Frame::Ptr& frame_1, const Frame::Ptr& frame_2,
-    const vector<int>& matches, Mat33& F,
+    const vector<pair<int, int>>& matches, Mat33& F,
     vector<pair<int, int>>& inlier_matches, const double noise_sigma,
     const double max_n_iters, const bool adaptive_iterations) {
-  // Retain only valid matches (i.e. those not -1)
-  vector<pair<int, int>> valid_matches;
-  valid_matches.reserve(matches.size());
-  for (int i = 0, i_end = matches.size(); i < i_end; ++i)
-    if (matches[i] != -1) valid_matches.push_back({i, matches[i]});
+  const vector<pair<int, int>>& valid_matches = matches;
   const int n_valid_matches = valid_matches.size();
   CHECK_GE(n_valid_matches, 8);  // We're using eight-point algorithm.
 
@@ -229,14 +225,9 @@ int GeometrySolver::evaluatePoseScore(
 
 bool GeometrySolver::P3PRansac(const Frame::Ptr& keyframe,
                                const Frame::Ptr& frame,
-                               const vector<int>& matches, SE3& relative_pose,
-                               const double noise_sigma) {
-  // Retain only valid matches;
-  const int num_matches = matches.size();
-  vector<pair<int, int>> valid_matches;
-  valid_matches.reserve(num_matches);
-  for (int i = 0; i < num_matches; ++i)
-    if (matches[i] != -1) valid_matches.push_back({i, matches[i]});
+                               const vector<pair<int, int>>& matches,
+                               SE3& relative_pose, const double noise_sigma) {
+  const vector<pair<int, int>>& valid_matches = matches;
   const int num_valid_matches = valid_matches.size();
 
   // Obtain matched map points and features which form the 3D-2D correspondences
@@ -250,6 +241,15 @@ bool GeometrySolver::P3PRansac(const Frame::Ptr& keyframe,
         feat_utils::getPoint(keyframe->feats_[valid_matches[i].first]));
     feats_f.push_back(frame->feats_[valid_matches[i].second]);
   }
+  return P3PRansac(frame, points, feats_f, relative_pose, noise_sigma);
+}
+
+bool GeometrySolver::P3PRansac(const Frame::Ptr& frame,
+                               const vector<MapPoint::Ptr>& points,
+                               const vector<Feature::Ptr>& feats_f, SE3& pose,
+                               const double noise_sigma) {
+  const int num_valid_matches = points.size();
+  if (num_valid_matches < 3) return false;
 
   // For the sake of efficiency, only few iterations of P3P are performed. The
   // qualify of the pose estimate will be further refined with pose graph
@@ -285,14 +285,14 @@ bool GeometrySolver::P3PRansac(const Frame::Ptr& keyframe,
     // thresholding test is maximized.
     SE3 best_T_c_w_i;
     const int best_score_i = GeometrySolver::evaluatePosesScore(
-        T_c_w_vec, points, feats_f, keyframe->cam_->K(), best_T_c_w_i,
+        T_c_w_vec, points, feats_f, frame->cam_->K(), best_T_c_w_i,
         2 * noise_sigma);
     if (best_score_i > best_score) {
       best_score = best_score_i;
       best_T_c_w = best_T_c_w_i;
     }
   }
-  relative_pose = best_T_c_w;
+  pose = best_T_c_w;
   return has_found;
 }
 
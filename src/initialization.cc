@@ -30,9 +30,9 @@ void Initializer::addCurrentFrame(Frame::Ptr curr_frame) {
   // if (curr_frame->id_ < ref_frame_->id_ + Config::new_kf_interval()) return;
   curr_frame_ = curr_frame;
   LOG(INFO) << "Current frame selected.";
-  // Matches between reference frame and current frame such that:
-  // last_frame_[i] = curr_frame_[matches[i]].
-  vector<int> matches;
+  // Matches (i, j) between reference frame and current frame such that:
+  // ref_frame_[i] = curr_frame_[j].
+  MatchList matches;
   const int n_matches =
       Matcher::searchForInitialization(ref_frame_, curr_frame_, matches);
   LOG(INFO) << "matches(ref_frame_, curr_frame_) = " << n_matches;
@@ -52,7 +52,7 @@ void Initializer::addCurrentFrame(Frame::Ptr curr_frame) {
   }
 }
 
-bool Initializer::initialize(const vector<int>& matches) {
+bool Initializer::initialize(const MatchList& matches) {
   // Find fundamental matrix F.
   Mat33 F;
   GeometrySolver::findFundamentalRansac(ref_frame_, curr_frame_, matches, F,
@@ -98,10 +98,10 @@ bool Initializer::buildInitMap() {
     point->addObservation(feat_1);
     point->addObservation(feat_2);
     // Link features with the map point.
-    feat_1->point_ = point;
-    feat_2->point_ = point;
+    feat_utils::linkPoint(feat_1, point);
+    feat_utils::linkPoint(feat_2, point);
     // Update map point characteristics.
-    point->updateBestFeature();
+    point->updateDescriptor();
     point->updateMedianViewDirAndScale();
     // Store the id of the frame where the map point is first observed by. Used
     // only for drawing purpose.
@@ -110,12 +110,13 @@ bool Initializer::buildInitMap() {
     tracker_->map_->insertMapPoint(point);
   }
 
-  // Update covisible information.
-  ref_frame_->updateCoInfo();
-  curr_frame_->updateCoInfo();
+  // Link the two keyframes in the covisibility graph.
+  tracker_->map_->co_graph_->addKeyframe(ref_frame_);
+  tracker_->map_->co_graph_->addKeyframe(curr_frame_);
 
   // Global bundle adjustment to optimize poses and points' position jointly.
   Optimizer::globalBA(tracker_->map_);
+  tracker_->map_->collectGarbage();
 
   // FIXME What is the rescaling principle under the hood?
   // Rescale the map such that the mean scene depth is equal to 1.0
@@ -133,7 +134,7 @@ bool Initializer::buildInitMap() {
        scale_factor * (curr_frame_->cam_->pos() - ref_frame_->cam_->pos()));
   curr_frame_->setPose(T_c_w_curr);
   // Scale the coordinates of map points.
-  const list<MapPoint::Ptr>& points = tracker_->map_->getAllMapPoints();
+  const vector<MapPoint::Ptr> points = tracker_->map_->getAllMapPoints();
   for (const auto& point : points) point->setPos(scale_factor * point->pos());
 
   return true;
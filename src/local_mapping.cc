@@ -7,7 +7,10 @@
 
 namespace mono_slam {
 
-LocalMapping::LocalMapping() : is_idle_(true) {}
+LocalMapping::LocalMapping() : is_idle_(true) {
+  //! The local mapping thread takes part in the work as well.
+  thread_pool_.reset(new ThreadPool(Config::n_mapper_threads() - 1));
+}
 
 void LocalMapping::startThread() {
   LOG(INFO) << "Local mapper is running ...";
@@ -59,6 +62,7 @@ void LocalMapping::LocalMappingLoop() {
     if (kfs_queue_.empty() && map_->nKfs() > 2)
       Optimizer::localBA(curr_keyframe_, map_);
     removeRedundantKfs();
+    map_->collectGarbage();
     LOG(INFO) << "Local mapper finished processing keyframe "
               << curr_keyframe_->id_;
     curr_keyframe_.reset();  // Always reseat shared_ptr once we don't need it.
@@ -70,13 +74,15 @@ void LocalMapping::processFrontKeyframe() {
   // Update links between current keyframe and map points.
   for (const Feature::Ptr& feat : curr_keyframe_->feats_) {
     const MapPoint::Ptr& point = feat_utils::getPoint(feat);
-    if (!point || !point->isObservedBy(curr_keyframe_)) continue;
+    // Skip those observed by this keyframe already.
+    if (!point || point->isObservedBy(curr_keyframe_)) continue;
     point->addObservation(feat);
-    point->updateBestFeature();
+    point->updateDescriptor();
     point->updateMedianViewDirAndScale();
+    map_->point_index_->insert(point);  // Re-index by the new descriptor.
   }
-  // Update covisibility information.
-  curr_keyframe_->updateCoInfo();
+  // Link to the covisible keyframes.
+  map_->co_graph_->addKeyframe(curr_keyframe_);
   // Insert to map the new keyframe.
   map_->insertKeyframe(curr_keyframe_);
   LOG(INFO) << "Map now has " << map_->nKfs() << " keyframes.";
@@ -84,11 +90,17 @@ void LocalMapping::processFrontKeyframe() {
 
 void LocalMapping::triangulateNewPoints() {
   // Get top 10 covisible keyframes ranked with number of shared map points.
-  const forward_list<Frame::Ptr>& co_kfs = curr_keyframe_->getCoKfs(10);
-
-  // Iterate all covisible keyframes.
-  int n_new_points = 0;
-  for (const Frame::Ptr& kf : co_kfs) {
+  const CovisibilityGraph::View kfs =
+      map_->co_graph_->getCoKfs(curr_keyframe_, 10);
+  const int n_kfs = kfs.size();
+
+  // Search for putative matches with all covisible keyframes in parallel.
+  //! Searching only reads the keyframes and the triangulation below does not
+  //! link features to the new points, hence the matches do not depend on the
+  //! order the keyframes are processed in.
+  vector<MatchList> matches_of_kfs(n_kfs);  // Empty if not triangulable.
+  thread_pool_->parallelFor(0, n_kfs, [&](const int k) {
+    const Frame::Ptr& kf = kfs[k];
     // Test if this keyframe and current keyframe under processing are able to
     // triangulate new good points.
 
@@ -97,21 +109,25 @@ void LocalMapping::triangulateNewPoints() {
         kf->cam_->getCamCenter() - curr_keyframe_->cam_->getCamCenter();
     const double median_depth = kf->computeSceneMedianDepth();
     // FIXME Magic 0.01?
-    if (baseline.norm() / median_depth < 0.01) continue;
+    if (baseline.norm() / median_depth < 0.01) return;
 
-    // Search for putative matches.
-    vector<int> matches;
+    MatchList& matches = matches_of_kfs[k];
     const int n_matches =
         Matcher::searchForTriangulation(kf, curr_keyframe_, matches);
-    if (n_matches < Config::tri_min_n_matches()) continue;
+    if (n_matches < Config::tri_min_n_matches()) matches.clear();
+  });
+
+  // Iterate all covisible keyframes.
+  int n_new_points = 0;
+  for (int k = 0; k < n_kfs; ++k) {
+    const Frame::Ptr& kf = kfs[k];
+    const MatchList& matches = matches_of_kfs[k];
 
     // Iterate all matches;
-    for (int i = 0, i_end = matches.size(); i < i_end; ++i) {
-      if (matches[i] == -1) continue;  // Skip unmatched features.
+    for (const pair<int, int>& match : matches) {
       // Test 2: sufficient parallax.
-      const Feature::Ptr &feat_1 = kf->feats_[i],
-                         &feat_2 = curr_keyframe_->feats_[matches[i]];
-      const Vec2 &pt_1 = feat_1->pt_, &pt_2 = feat_2->pt_;
+      const int i = match.first, j = match.second;
+      const Vec2 &pt_1 = kf->pts_[i], &pt_2 = curr_keyframe_->pts_[j];
       const Vec3 bear_vec_1 = kf->cam_->pixel2bear(pt_1),
                  bear_vec_2 = curr_keyframe_->cam_->pixel2bear(pt_2);
       const double cos_parallax =
@@ -137,7 +153,7 @@ void LocalMapping::triangulateNewPoints() {
       const double repr_err_1 = geometry::computeReprErr(point_1, pt_1, K_1),
                    repr_err_2 = geometry::computeReprErr(point_2, pt_2, K_2);
       const double chi2_thresh = 5.991;  // Two-degree chi-square p-value.
-      const int level_1 = feat_1->level_, level_2 = feat_2->level_;
+      const int level_1 = kf->levels_[i], level_2 = curr_keyframe_->levels_[j];
       if (repr_err_1 > Config::scale_level_sigma2().at(level_1) * chi2_thresh ||
           repr_err_2 > Config::scale_level_sigma2().at(level_2) * chi2_thresh)
         continue;
@@ -157,10 +173,11 @@ void LocalMapping::triangulateNewPoints() {
 
       // Create new map point if all tests are passed.
       MapPoint::Ptr point = make_shared<MapPoint>(point_1);
-      point->addObservation(feat_1);
-      point->addObservation(feat_2);
+      point->addObservation(kf->feats_[i]);
+      point->addObservation(curr_keyframe_->feats_[j]);
+      map_->co_graph_->addObservation(point, curr_keyframe_);
       // Update observation information.
-      point->updateBestFeature();
+      point->updateDescriptor();
       point->updateMedianViewDirAndScale();
       // Store the id of the frame where the point is first observed by. Used
       // only for drawing purpose.
@@ -176,7 +193,9 @@ void LocalMapping::triangulateNewPoints() {
 
 void LocalMapping::removeRedundantKfs() {
   // Iterate all covisible keyframes.
-  const forward_list<Frame::Ptr>& co_kfs = curr_keyframe_->co_kfs_;
+  //! The view stays valid as keyframes are removed from the graph below.
+  const CovisibilityGraph::View co_kfs =
+      map_->co_graph_->getCoKfs(curr_keyframe_);
   int n_redun_kfs = 0;
   for (const Frame::Ptr& kf_ : co_kfs) {
     int n_points = 0;            // Number of effective map points.
@@ -184,20 +203,21 @@ void LocalMapping::removeRedundantKfs() {
     const int n_obs_thresh = 3;  // If more than three keyframes observing the
                                  // same map point, it's marked as redundant.
     // Iterate all linked map points of this keyframe.
-    for (const Feature::Ptr& feat_ : kf_->feats_) {
-      const MapPoint::Ptr& point = feat_utils::getPoint(feat_);
+    const int n_obs_kf = kf_->nObs();
+    for (int i = 0; i < n_obs_kf; ++i) {
+      const MapPoint::Ptr& point = feat_utils::getPoint(kf_->feats_[i]);
       if (!point) continue;
       ++n_points;
+      const int level = kf_->levels_[i];
 
       // Iterate all observations of this map point.
       int n_obs = 0;  // Number of observations of this map point.
-      const list<Feature::Ptr>& observations = point->getObservations();
-      for (const Feature::Ptr& feat : observations) {
+      const MapPoint::ObsSnapshot observations = point->getObservations();
+      for (const Feature::Ptr& feat : *observations) {
         const Frame::Ptr& kf = feat_utils::getKeyframe(feat);
         if (!kf || kf == kf_) continue;  // Self is of course excluded.
         // Features must be detected in neighbor scales.
-        if (feat->level_ >= feat_->level_ - 1 &&
-            feat->level_ <= feat_->level_ + 1)
+        if (feat->level_ >= level - 1 && feat->level_ <= level + 1)
           ++n_obs;
         if (n_obs >= n_obs_thresh) break;
       }
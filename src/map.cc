@@ -1,13 +1,16 @@
 #include "mono_slam/map.h"
 
 #include "mono_slam/config.h"
+#include "mono_slam/utils/id_scratch.h"
 
 namespace mono_slam {
 
 //##############################################################################
 // KeyframeDataBase
 
-KeyframeDataBase::KeyframeDataBase(sptr<Vocabulary> voc) : voc_(voc) {
+KeyframeDataBase::KeyframeDataBase(sptr<Vocabulary> voc,
+                                   const CovisibilityGraph* co_graph)
+    : voc_(voc), co_graph_(co_graph) {
   // Personally, only approximately 20% of ids would be used.
   inv_files_.reserve(Config::approx_n_words_pct() * voc_->size());
 }
@@ -25,11 +28,9 @@ void KeyframeDataBase::erase(const Frame::Ptr& keyframe) {
   auto it = bow_vec.cbegin(), it_end = bow_vec.cend();
   for (; it != it_end; ++it) {
     if (!inv_files_.count(it->first)) continue;
-    list<Frame::Ptr>& kfs = inv_files_.at(it->first);
-    // FIXME Campturing by reference lose const qualifier?
-    std::remove_if(kfs.begin(), kfs.end(), [&keyframe](const Frame::Ptr& kf) {
-      return kf == keyframe;
-    });
+    //! std::remove_if only moves the kept keyframes to the front, leaving
+    //! null pointers in the tail, while list::remove erases the nodes.
+    inv_files_.at(it->first).remove(keyframe);
   }
 }
 
@@ -38,6 +39,15 @@ bool KeyframeDataBase::detectRelocCandidates(const Frame::Ptr& frame,
   LOG(INFO) << "Start detecting relocalization candiates ...";
   const steady_clock::time_point t1 = steady_clock::now();
 
+  // Query-local state keyed by keyframe id. A keyframe has an entry in
+  // n_sharing_words iff it was visited by this query.
+  thread_local IdScratch<int> n_sharing_words;  // Number of sharing words.
+  thread_local IdScratch<double> bow_simi_scores;  // Similarity scores.
+  thread_local IdSet is_candidate;  // Selected as candidate already?
+  n_sharing_words.reset();
+  bow_simi_scores.reset();
+  is_candidate.reset();
+
   // Obtain keyframes sharing words with currently quering frame.
   list<Frame::Ptr> kfs_sharing_words;  // Keframes sharing words.
   const DBoW3::BowVector& bow_vec = frame->bow_vec_;
@@ -49,12 +59,8 @@ bool KeyframeDataBase::detectRelocCandidates(const Frame::Ptr& frame,
       const list<Frame::Ptr>& kfs = inv_files_.at(it->first);
       for (const Frame::Ptr& kf : kfs) {
         // If not queried yet.
-        if (kf->query_frame_id_ != frame->id_) {
-          kf->query_frame_id_ = frame->id_;
-          kf->n_sharing_words_ = 0;
-          kfs_sharing_words.push_back(kf);
-        }
-        kf->n_sharing_words_++;
+        if (!n_sharing_words.contains(kf->id_)) kfs_sharing_words.push_back(kf);
+        ++n_sharing_words[kf->id_];
       }
     }
   }
@@ -64,16 +70,17 @@ bool KeyframeDataBase::detectRelocCandidates(const Frame::Ptr& frame,
   // out bad keyframe candidates.
   int max_n_sharing_words = 0;
   for (const Frame::Ptr& kf : kfs_sharing_words)
-    if (kf->n_sharing_words_ > max_n_sharing_words)
-      max_n_sharing_words = kf->n_sharing_words_;
+    if (n_sharing_words[kf->id_] > max_n_sharing_words)
+      max_n_sharing_words = n_sharing_words[kf->id_];
   const int n_sharing_words_thresh = 0.80 * max_n_sharing_words;
 
   // Filter out bad keyframe candidates and compute bow similarity score.
   list<pair<double, Frame::Ptr>> score_of_kfs;
   for (const Frame::Ptr& kf : kfs_sharing_words) {
-    if (kf->n_sharing_words_ <= n_sharing_words_thresh) continue;
-    kf->bow_simi_score_ = voc_->score(kf->bow_vec_, frame->bow_vec_);
-    score_of_kfs.push_back({kf->bow_simi_score_, kf});
+    if (n_sharing_words[kf->id_] <= n_sharing_words_thresh) continue;
+    const double score = voc_->score(kf->bow_vec_, frame->bow_vec_);
+    bow_simi_scores[kf->id_] = score;
+    score_of_kfs.push_back({score, kf});
   }
 
   // Collect covisible keyframes with each candidate keyframe and accumulate
@@ -85,19 +92,20 @@ bool KeyframeDataBase::detectRelocCandidates(const Frame::Ptr& frame,
        it != it_end; ++it) {
     const Frame::Ptr& kf = it->second;
     // Collect top 10 covisible keyframes ranked wrt. number of shared words.
-    const forward_list<Frame::Ptr>& co_kfs = kf->getCoKfs(10);
+    const CovisibilityGraph::View co_kfs = co_graph_->getCoKfs(kf, 10);
 
     // Traverse the covisible keyframes and accumulate the similarity score.
-    double max_score_i = kf->bow_simi_score_, accu_score_i = max_score_i;
+    double max_score_i = it->first, accu_score_i = max_score_i;
     Frame::Ptr best_kf_i = kf;
     for (const Frame::Ptr& kf_ : co_kfs) {
       // Only the keyframes visited before are considered having contribution.
-      if (kf_->query_frame_id_ != frame->id_) continue;
-      if (kf_->bow_simi_score_ > max_score_i) {
-        max_score_i = kf_->bow_simi_score_;
+      if (!n_sharing_words.contains(kf_->id_)) continue;
+      const double score = bow_simi_scores[kf_->id_];
+      if (score > max_score_i) {
+        max_score_i = score;
         best_kf_i = kf_;
       }
-      accu_score_i += kf_->bow_simi_score_;
+      accu_score_i += score;
     }
 
     // The accumulated score and best keyframe in this group are retained.
@@ -110,10 +118,9 @@ bool KeyframeDataBase::detectRelocCandidates(const Frame::Ptr& frame,
   int n_can_kfs = 0;
   for (auto it = score_of_best_kfs.cbegin(), it_end = score_of_best_kfs.cend();
        it != it_end; ++it) {
-    if (it->first <= score_thresh || it->second->is_candidate_already_)
+    if (it->first <= score_thresh || !is_candidate.insert(it->second->id_))
       continue;
     candidate_kfs.push_back(it->second);
-    it->second->is_candidate_already_ = true;
     ++n_can_kfs;
   }
 
@@ -121,12 +128,6 @@ bool KeyframeDataBase::detectRelocCandidates(const Frame::Ptr& frame,
   const double time_span = duration_cast<duration<double>>(t2 - t1).count();
   LOG(INFO) << n_can_kfs << " relocalization candidates detected.";
   LOG(INFO) << "Relocalization finished in " << time_span << " seconds.";
-
-  // Reset the keyframes.
-  std::for_each(score_of_best_kfs.cbegin(), score_of_best_kfs.cend(),
-                [](const pair<double, Frame::Ptr>& p) {
-                  p.second->is_candidate_already_ = false;
-                });
   return true;
 }
 
@@ -135,14 +136,35 @@ void KeyframeDataBase::clear() {
   inv_files_.reserve(Config::approx_n_words_pct() * voc_->size());
 }
 
+//##############################################################################
+// MapSnapshot
+
+bool MapSnapshot::getChangesSince(const std::uint64_t since,
+                                  vector<MapDelta::Ptr>& deltas) const {
+  deltas.clear();
+  if (since >= version_) return true;
+  // Versions of retained deltas are consecutive and end at version_.
+  if (deltas_.empty() || deltas_.front()->version > since + 1) return false;
+  const int n_deltas = version_ - since;
+  deltas.assign(deltas_.cend() - n_deltas, deltas_.cend());
+  return true;
+}
+
 //##############################################################################
 // Map
 
 Map::Map(sptr<Vocabulary> voc) : voc_(voc), max_kf_id_(-1) {
-  kf_db_.reset(new KeyframeDataBase(voc_));
+  co_graph_.reset(new CovisibilityGraph());
+  kf_db_.reset(new KeyframeDataBase(voc_, co_graph_.get()));
+  point_index_.reset(new DescriptorIndex());
+  std::atomic_store(&snapshot_, make_shared<const MapSnapshot>());
 }
 
 void Map::insertKeyframe(Frame::Ptr keyframe) {
+  // Bag of words are only needed for keyframes, hence computed here. This is
+  // run by the local mapper for all keyframes but the initial two, keeping the
+  // vocabulary descent out of the tracking thread.
+  keyframe->computeBoW(*voc_);
   lock_g lock(mut_);
   CHECK_EQ(keyframe->isKeyframe(), true);
   if (keyframe->id_ <= max_kf_id_) {
@@ -150,61 +172,126 @@ void Map::insertKeyframe(Frame::Ptr keyframe) {
     return;
   }
   max_kf_id_ = keyframe->id_;
-  kfs_.push_back(keyframe);
+  kfs_.insert(keyframe->id_, keyframe);
+  pending_delta_.added_kfs.push_back(keyframe);
   kf_db_->add(keyframe);  // Also add to keyframe database.
   LOG(INFO) << "New keyframe inserted to map.";
 }
 
 void Map::insertMapPoint(MapPoint::Ptr point) {
+  point_index_->insert(point);
   lock_g lock(mut_);
-  points_.push_back(point);
+  if (points_.insert(point->id_, point))
+    pending_delta_.added_points.push_back(point);
 }
 
 void Map::removeKeyframe(const Frame::Ptr& keyframe) {
+  co_graph_->eraseKeyframe(keyframe);
   lock_g lock(mut_);
-  kfs_.remove(keyframe);  // Just call list::remove and that's it!
-}
-
-void Map::removeBadMapPoints() {
-  lock_g lock(mut_);
-  // Just call list::remove_if and that's it!
-  points_.remove_if(
-      [](const MapPoint::Ptr& point) { return point->to_be_deleted_; });
+  if (kfs_.erase(keyframe->id_)) {
+    bad_kfs_.push_back(keyframe);
+    pending_delta_.removed_kf_ids.push_back(keyframe->id_);
+  }
 }
 
 void Map::removeBadObservations(const Frame::Ptr& keyframe,
                                 Feature::Ptr& feat) {
-  // Avoid repeat removal of map points since a single map point could be
-  // observed by many features.
-  if (feat->point_.expired()) return;
+  // Avoid repeat removal since the observation may be rejected by several
+  // edges.
+  const MapPoint::Ptr point = feat->point_.lock();
+  if (!point) return;
+  // Unlink the observation right away such that matching and optimization no
+  // longer use it, i.e. the point forgets the feature and vice versa. The
+  // covisibility weights it contributed are dropped first.
+  co_graph_->eraseObservation(point, keyframe);
+  point->eraseObservation(feat);
   {  // Lock since we're changing the state of map points.
     lock_g lock(mut_);
-    MapPoint::Ptr point = feat->point_.lock();
-    // If less than 3 frames observing this map point after the feature is
-    // erased and the observation is marked bad, this map point is removed from
-    // map.
-    if (point->nObs() - 1 < 3)
+    // If less than 3 frames observing this map point after the observation is
+    // erased, this map point is marked bad and only its removal from the map
+    // is deferred to collectGarbage().
+    if (point->nObs() < 3) {
+      if (!point->to_be_deleted_) bad_points_.push_back(point);
       point->to_be_deleted_ = true;
-    else {
+      // Unlink the remaining features as well such that the bad point is no
+      // longer reachable from keyframes.
+      //! Its observations are kept for updating the covisibility graph.
+      const MapPoint::ObsSnapshot observations = point->getObservations();
+      for (const Feature::Ptr& feat_ : *observations)
+        feat_utils::unlinkPoint(feat_);
+    } else {
       // If not goint to be deleted, update infos of the point.
-      point->updateBestFeature();
+      point->updateDescriptor();
       point->updateMedianViewDirAndScale();
+      point_index_->insert(point);  // Re-index by the new descriptor.
     }
   }
-  // Erase observation.
-  //! Since map point only "obseres" feature (through weak_ptr) and each feature
-  //! is uniquely owned by a keyframe, simply reseat the feature pointer is
-  //! sufficient to finish the removal of observation.
   feat.reset();
-  // Remove bad map points.
-  removeBadMapPoints();  // Remove those marked as to_be_deleted_.
+}
+
+void Map::collectGarbage() {
+  lock_g lock(mut_);
+  // Remove from the map the objects gone bad in this epoch.
+  const std::uint64_t epoch = epochs_.epoch();
+  for (MapPoint::Ptr& point : bad_points_) {
+    if (points_.erase(point->id_))
+      pending_delta_.removed_point_ids.push_back(point->id_);
+    point_index_->erase(point);
+    co_graph_->erasePoint(point);
+    retired_points_.emplace_back(epoch, std::move(point));
+  }
+  for (Frame::Ptr& kf : bad_kfs_) {
+    kf_db_->erase(kf);
+    retired_kfs_.emplace_back(epoch, std::move(kf));
+  }
+  bad_points_.clear();
+  bad_kfs_.clear();
+  publishSnapshot();
+
+  // Release those no reader could access any more.
+  //! Epochs are non-decreasing along the queues.
+  const std::uint64_t safe_epoch = epochs_.advance();
+  while (!retired_points_.empty() &&
+         retired_points_.front().first < safe_epoch)
+    retired_points_.pop_front();
+  while (!retired_kfs_.empty() && retired_kfs_.front().first < safe_epoch)
+    retired_kfs_.pop_front();
 }
 
 void Map::clear() {
   lock_g lock(mut_);
   kfs_.clear();
+  points_.clear();
   max_kf_id_ = 0;
   kf_db_->clear();
+  point_index_->clear();
+  co_graph_->clear();
+  bad_points_.clear();
+  bad_kfs_.clear();
+  // Publish the empty map. Having no deltas, readers start over from it.
+  auto snapshot = make_shared<MapSnapshot>();
+  snapshot->version_ = std::atomic_load(&snapshot_)->version_ + 1;
+  pending_delta_ = MapDelta();
+  std::atomic_store(&snapshot_, MapSnapshot::Ptr(std::move(snapshot)));
+}
+
+void Map::publishSnapshot() {
+  const MapSnapshot::Ptr last = std::atomic_load(&snapshot_);
+  auto snapshot = make_shared<MapSnapshot>();
+  snapshot->version_ = last->version_ + 1;
+  snapshot->kfs_ = kfs_.snapshot();
+  snapshot->points_ = points_.snapshot();
+  // Retain the latest deltas, the pending one being the last.
+  pending_delta_.version = snapshot->version_;
+  const int n_kept =
+      std::min<int>(last->deltas_.size(), MapSnapshot::kMaxNumDeltas - 1);
+  snapshot->deltas_.reserve(n_kept + 1);
+  snapshot->deltas_.assign(last->deltas_.cend() - n_kept,
+                           last->deltas_.cend());
+  snapshot->deltas_.push_back(
+      make_shared<const MapDelta>(std::move(pending_delta_)));
+  pending_delta_ = MapDelta();
+  std::atomic_store(&snapshot_, MapSnapshot::Ptr(std::move(snapshot)));
 }
 
 }  // namespace mono_slam
\ No newline at end of file
@@ -3,18 +3,40 @@
 #include "mono_slam/feature.h"
 #include "mono_slam/frame.h"
 #include "mono_slam/matcher.h"
+#include "mono_slam/matcher/hamming.h"
 #include "mono_slam/utils/math_utils.h"
 
 namespace mono_slam {
 
+namespace {
+
+// Distance between two descriptors of n_bytes bytes. ORB descriptors take the
+// kernels selected for the running CPU.
+inline int descDist(const DescBuffer& desc_1, const DescBuffer& desc_2,
+                    const int n_bytes) {
+  if (n_bytes == 32) return hamming::distance(desc_1.data(), desc_2.data());
+  return hamming::distanceFixed<DescBuffer::kMaxBytes>(desc_1.data(),
+                                                       desc_2.data());
+}
+
+}  // namespace
+
 int MapPoint::point_cnt_ = 0;
 
 MapPoint::MapPoint(const Vec3& pos)
-    : id_(point_cnt_++), pos_(pos), to_be_deleted_(false) {}
+    : id_(point_cnt_++),
+      pos_(pos),
+      to_be_deleted_(false),
+      observations_(make_shared<const Observations>()) {}
 
 MapPoint::MapPoint(const Vec3& pos, sptr<Feature> feat)
-    : id_(point_cnt_++), pos_(pos), best_feat_(feat), to_be_deleted_(false) {
-  observations_.push_back(feat);
+    : id_(point_cnt_++),
+      pos_(pos),
+      to_be_deleted_(false),
+      observations_(make_shared<const Observations>(Observations{feat})) {
+  addObsDescriptor(feat);
+  descriptor_ = obs_descs_.front();
+  has_descriptor_ = true;
 }
 
 void MapPoint::setPos(const Vec3& pos) {
@@ -24,69 +46,102 @@ void MapPoint::setPos(const Vec3& pos) {
 
 void MapPoint::addObservation(sptr<Feature> feat) {
   u_lock lock(mutex_);
-  observations_.push_back(feat);
+  // Copy, modify and publish. Readers holding the old version are unaffected.
+  auto observations = make_shared<Observations>();
+  const ObsSnapshot& curr = observations_;
+  observations->reserve(curr->size() + 1);
+  *observations = *curr;
+  observations->push_back(feat);
+  publishObservations(std::move(observations));
+  if (!is_obs_dists_stale_) addObsDescriptor(feat);
 }
 
 void MapPoint::eraseObservation(const sptr<Feature>& feat) {
   u_lock lock(mutex_);
-  for (auto it = observations_.begin(), it_end = observations_.end();
-       it != it_end; ++it) {
-    if (*it == feat) {
-      observations_.erase(it);
-      feat->point_.reset();
-      break;  // FIXME Should we break out immediately?
-    }
-  }
+  const ObsSnapshot& curr = observations_;
+  auto it = std::find(curr->cbegin(), curr->cend(), feat);
+  if (it == curr->cend()) return;
+  auto observations = make_shared<Observations>();
+  observations->reserve(curr->size() - 1);
+  observations->insert(observations->end(), curr->cbegin(), it);
+  observations->insert(observations->end(), std::next(it), curr->cend());
+  publishObservations(std::move(observations));
+  feat_utils::unlinkPoint(feat);
+  // Positions of the cached distances are not tracked, hence rebuilt on the
+  // next update.
+  is_obs_dists_stale_ = true;
 }
 
-void MapPoint::updateBestFeature() {
-  const list<sptr<Feature>>& observations = this->getObservations();
-  if (to_be_deleted_) return;
-  // Container of all available features.
-  vector<sptr<Feature>> feats;
-  feats.reserve(observations.size());
-  for (const sptr<Feature>& feat : observations) {
-    feats.push_back(feat);
+void MapPoint::addObsDescriptor(const sptr<Feature>& feat) {
+  desc_bytes_ = feat->descriptor_.cols;
+  const DescBuffer desc(feat->descriptor_.ptr<uchar>(), desc_bytes_);
+  const int n = obs_descs_.size();
+  vector<int> dists(n + 1, 0);
+  for (int i = 0; i < n; ++i) {
+    dists[i] = descDist(obs_descs_[i], desc, desc_bytes_);
+    obs_dists_[i].push_back(dists[i]);
   }
+  obs_descs_.push_back(desc);
+  obs_dists_.push_back(std::move(dists));
+}
 
-  const int num_feats = feats.size();
-  vector<vector<int>> dists(num_feats, vector<int>(num_feats));
-  // Compute pairwise distances row by row.
-  for (int i = 0; i < num_feats; ++i) {  // row i.
-    dists[i][i] = 0;
-    // Computing upper triangular suffices.
-    for (int j = i + 1; j < num_feats; ++j) {  // col j.
-      const int dist = matcher_utils::computeDescDist(feats[i]->descriptor_,
-                                                      feats[j]->descriptor_);
-      dists[i][j] = dist;
-      dists[j][i] = dist;
+void MapPoint::updateDescriptor() {
+  if (to_be_deleted_) return;
+  u_lock lock(mutex_);
+  if (is_obs_dists_stale_) {
+    // Recompute all pairwise distances in a batch.
+    //! Writers are serialized by mutex_, hence the snapshot is current.
+    const Observations& observations = *observations_;
+    const int n = observations.size();
+    obs_descs_.clear();
+    obs_descs_.reserve(n);
+    for (const sptr<Feature>& feat : observations) {
+      desc_bytes_ = feat->descriptor_.cols;
+      obs_descs_.emplace_back(feat->descriptor_.ptr<uchar>(), desc_bytes_);
     }
+    vector<int> dists(n * n);
+    if (n > 0 && desc_bytes_ == 32) {
+      hamming::distanceManyToMany(obs_descs_.front().data(), sizeof(DescBuffer),
+                                  n, obs_descs_.front().data(),
+                                  sizeof(DescBuffer), n, dists.data());
+    } else {
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+          dists[i * n + j] =
+              descDist(obs_descs_[i], obs_descs_[j], desc_bytes_);
+    }
+    obs_dists_.resize(n);
+    for (int i = 0; i < n; ++i)
+      obs_dists_[i].assign(dists.begin() + i * n, dists.begin() + (i + 1) * n);
+    is_obs_dists_stale_ = false;
   }
 
-  // Obtain the best feature which has the least median distance with others.
-  int least_median_dist = 256;
+  const int n = obs_descs_.size();
+  if (n == 0) return;
+  // Obtain the descriptor which has the least median distance with others.
+  int least_median_dist = std::numeric_limits<int>::max();
   int idx = 0;
-  for (int i = 0; i < num_feats; ++i) {
-    vector<int> dists_row_i(dists[i].begin(), dists[i].end());
+  vector<int> dists_row_i;
+  dists_row_i.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    dists_row_i.assign(obs_dists_[i].cbegin(), obs_dists_[i].cend());
     const int median_dist = math_utils::get_median(dists_row_i);
     if (median_dist < least_median_dist) {
       least_median_dist = median_dist;
       idx = i;
     }
   }
-  {
-    u_lock lock(mutex_);
-    best_feat_ = feats[idx];
-  }
+  descriptor_ = obs_descs_[idx];
+  has_descriptor_ = true;
 }
 
 void MapPoint::updateMedianViewDirAndScale() {
   const Vec3 pos = this->pos();
-  lock_g lock(mutex_);
+  const ObsSnapshot observations = getObservations();
   Vec3 total_view_dir;  // Container for viewing directions.
   vector<int> levels;   // Container for viewing scales (aka. levels).
   int n = 0;
-  for (const sptr<Feature>& feat : observations_) {
+  for (const sptr<Feature>& feat : *observations) {
     if (feat->frame_.expired()) continue;
     const auto& frame = feat->frame_.lock();
     const Vec3 unit_bear_vec = frame->cam_->getUnitBearVec(pos);
@@ -98,14 +153,15 @@ void MapPoint::updateMedianViewDirAndScale() {
   // Obtain median.
   //! Since the median of circular data is not well-defined, we simply use mean
   //! to replace it. Hopefully, we will solve it soon.
+  lock_g lock(mutex_);
   median_view_dir_ = total_view_dir / n;
   median_view_scale_ = math_utils::get_median(levels);
 }
 
 bool MapPoint::isObservedBy(const sptr<Frame>& keyframe) const {
   CHECK_EQ(keyframe->isKeyframe(), true);
-  u_lock lock(mutex_);
-  for (const sptr<Feature>& feat : observations_)
+  const ObsSnapshot observations = getObservations();
+  for (const sptr<Feature>& feat : *observations)
     if (feat->frame_.lock() == keyframe) return true;
   return false;
 }
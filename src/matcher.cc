@@ -4,32 +4,66 @@
 #include "mono_slam/config.h"
 #include "mono_slam/feature.h"
 #include "mono_slam/geometry_solver.h"
+#include "mono_slam/matcher/flat_feature_vector.h"
+#include "mono_slam/matcher/hamming.h"
+#include "mono_slam/utils/id_scratch.h"
+#include "mono_slam/utils/math_utils.h"
 
 namespace mono_slam {
 
-int Matcher::searchForInitialization(const Frame::Ptr& ref_frame,
-                                     const Frame::Ptr& curr_frame,
-                                     vector<int>& matches) {
+namespace {
+
+// Number of map points matched by each task in parallel searching.
+constexpr int kNumPointsPerTask = 32;
+
+// Angle of the line with direction (dx, dy), in [0, pi).
+inline double lineAngle(const double dx, const double dy) {
+  double angle = std::atan2(dy, dx);
+  if (angle < 0.) angle += EIGEN_PI;
+  return angle >= EIGEN_PI ? 0. : angle;
+}
+
+// Match the local points gathered in the workspace against the features of
+// curr_frame. \sa BasicMatcher::searchByProjection.
+template <typename Desc>
+int matchLocalPoints(const Frame::Ptr& curr_frame, MatchWorkspace& ws);
+
+}  // namespace
+
+MatchWorkspace& MatchWorkspace::local() {
+  thread_local MatchWorkspace ws;
+  return ws;
+}
+
+template <typename Desc>
+int BasicMatcher<Desc>::searchForInitialization(const Frame::Ptr& ref_frame,
+                                                const Frame::Ptr& curr_frame,
+                                                MatchList& matches,
+                                                MatchWorkspace& ws) {
+  CHECK_EQ(curr_frame->descriptors_.cols, Desc::kBytes);
   const int n_obs_1 = ref_frame->nObs(), n_obs_2 = curr_frame->nObs();
-  matches.assign(n_obs_1, -1);  // -1 denotes no matching.
+  matches.clear();
   // Record as well reverse matching to avoid repeat matching.
-  vector<bool> matched(n_obs_2, false);
+  vector<std::uint8_t>& matched = ws.matched;
+  matched.assign(n_obs_2, false);
 
-  int n_matches = 0;
+  vector<int>& feat_indices_2 = ws.feat_indices;
+  // Descriptor distances against searched features.
+  vector<int>& dists = ws.dists;
   for (int idx_1 = 0; idx_1 < n_obs_1; ++idx_1) {
-    const Feature::Ptr& feat_1 = ref_frame->feats_[idx_1];
-    const int level = feat_1->level_;
+    const int level = ref_frame->levels_[idx_1];
     if (level > 0) continue;  // Only consider the finest level.
-    const vector<int> feat_indices_2 = curr_frame->searchFeatures(
-        feat_1->pt_, Config::search_radius(), level, level);
+    curr_frame->searchFeatures(ref_frame->pts_[idx_1], Config::search_radius(),
+                               level, level, feat_indices_2);
     if (feat_indices_2.empty()) continue;
 
-    int min_dist = 256, second_min_dist = 256, best_idx_2 = 0;
-    for (const int idx_2 : feat_indices_2) {
+    matcher_utils::computeDescDists<Desc>(ref_frame->descriptor(idx_1),
+                                          curr_frame, feat_indices_2, dists);
+    int min_dist = Desc::kBits, second_min_dist = Desc::kBits, best_idx_2 = 0;
+    for (int k = 0, k_end = feat_indices_2.size(); k < k_end; ++k) {
+      const int idx_2 = feat_indices_2[k];
       if (matched[idx_2]) continue;  // Avoid repeat matching.
-      const Feature::Ptr& feat_2 = curr_frame->feats_[idx_2];
-      const int dist = matcher_utils::computeDescDist(feat_1->descriptor_,
-                                                      feat_2->descriptor_);
+      const int dist = dists[k];
       if (dist < min_dist) {
         second_min_dist = min_dist;
         min_dist = dist;
@@ -39,270 +73,502 @@ int Matcher::searchForInitialization(const Frame::Ptr& ref_frame,
     }
 
     // Check matching threshold and apply distance ratio test.
-    if (min_dist >= Config::match_thresh_relax() ||
+    if (min_dist >= Desc::scaleThresh(Config::match_thresh_relax()) ||
         min_dist >= Config::dist_ratio_test_factor() * second_min_dist)
       continue;
     // Update matches.
-    matches[idx_1] = best_idx_2;
+    matches.emplace_back(idx_1, best_idx_2);
     matched[best_idx_2] = true;
-    ++n_matches;
   }
-  return n_matches;
+  return matches.size();
 }
 
-int Matcher::searchByProjection(const Frame::Ptr& last_frame,
-                                const Frame::Ptr& curr_frame) {
-  return Matcher::searchByProjection(unordered_set<Frame::Ptr>{last_frame},
-                                     curr_frame);
+template <typename Desc>
+int BasicMatcher<Desc>::searchByProjection(const Frame::Ptr& last_frame,
+                                           const Frame::Ptr& curr_frame,
+                                           MatchWorkspace& ws) {
+  matcher_utils::gatherLocalPoints(last_frame, ws.local_points);
+  return matchLocalPoints<Desc>(curr_frame, ws);
 }
 
-int Matcher::searchByProjection(const unordered_set<Frame::Ptr>& local_co_kfs,
-                                const Frame::Ptr& curr_frame) {
+template <typename Desc>
+int BasicMatcher<Desc>::searchByProjection(
+    const unordered_set<Frame::Ptr>& local_co_kfs, const Frame::Ptr& curr_frame,
+    MatchWorkspace& ws) {
   if (local_co_kfs.empty()) return 0;
+  matcher_utils::gatherLocalPoints(local_co_kfs, ws.local_points);
+  return matchLocalPoints<Desc>(curr_frame, ws);
+}
+
+namespace {
+
+template <typename Desc>
+int matchLocalPoints(const Frame::Ptr& curr_frame, MatchWorkspace& ws) {
+  CHECK_EQ(curr_frame->descriptors_.cols, Desc::kBytes);
+  static_assert(Desc::kBytes <= DescBuffer::kMaxBytes,
+                "Map point descriptors are too short.");
   int n_matches = 0;
 
-  // Iterate each keyframe->feature->map_point to find the best matches between
-  // the map_point and features in curr_frame.
+  // Project the gathered points onto current frame in a batch, leaving only
+  // the visible ones to be matched.
+  const matcher_utils::LocalPoints& local_points = ws.local_points;
+  matcher_utils::projectLocalPoints(curr_frame, ws.local_points);
 
-  // Helper container used to reset the marker.
-  unordered_set<MapPoint::Ptr> shared_points;
-  for (const Frame::Ptr& kf : local_co_kfs) {
-    for (const Feature::Ptr& feat : kf->feats_) {
-      const MapPoint::Ptr& point = feat_utils::getPoint(feat);
-      if (!point || point->curr_tracked_frame_id_ == curr_frame->id_) continue;
-      point->curr_tracked_frame_id_ = curr_frame->id_;
-      shared_points.insert(point);
-      if (!curr_frame->isObservable(point, feat->level_)) continue;
+  // Find the best match of each visible map point among the unmatched
+  // features in curr_frame. Points are split into chunks of fixed size
+  // processed in parallel.
+  const int n_visible = local_points.visible.size();
+  vector<int>& best_indices = ws.best_indices;
+  vector<int>& best_dists = ws.best_dists;
+  best_indices.assign(n_visible, -1);
+  best_dists.assign(n_visible, Desc::kBits);
+  const int n_chunks = (n_visible + kNumPointsPerTask - 1) / kNumPointsPerTask;
+  matcher_utils::threadPool().parallelFor(0, n_chunks, [&](const int chunk) {
+    //! Each task uses the workspace of the thread running it. The calling
+    //! thread runs tasks as well and its workspace may be ws itself, hence
+    //! tasks only touch the buffers unused by the caller at this point.
+    MatchWorkspace& task_ws = MatchWorkspace::local();
+    vector<int>& feat_indices = task_ws.feat_indices;
+    // Descriptor distances against searched features.
+    vector<int>& dists = task_ws.dists;
+    const int j_begin = chunk * kNumPointsPerTask;
+    const int j_end = std::min(j_begin + kNumPointsPerTask, n_visible);
+    for (int j = j_begin; j < j_end; ++j) {
+      const int i = local_points.visible[j];
 
       // Perform 3D-2D searching.
       // Search radius is enlarged at larger scale and also influenced by
       // viewing direction from the camera center of current frame.
-      const int level = point->level_;
+      const int level = local_points.levels[i];
       const int search_radius =
           Config::search_radius() *
-          Config::search_view_dir_factor(point->cos_view_dir_) *
+          Config::search_view_dir_factor(local_points.cos_view_dirs[i]) *
           Config::scale_factors().at(level);
-      const vector<int> feat_indices =
-          curr_frame->searchFeatures(Vec2{point->repr_x_, point->repr_y_},
-                                     search_radius, level - 1, level + 1);
+      curr_frame->searchFeatures(local_points.repr_pts.col(i), search_radius,
+                                 level - 1, level + 1, feat_indices);
       if (feat_indices.empty()) continue;
 
       // Iterate all matched features in current frame to find best and second
       // best matches.
-      int min_dist = 256, second_min_dist = 256;
+      matcher_utils::computeDescDists<Desc>(local_points.descs[i].data(),
+                                            curr_frame, feat_indices, dists);
+      int min_dist = Desc::kBits, second_min_dist = Desc::kBits;
       int best_level = 0, second_best_level = 0;
       int best_idx = 0;
-      for (int idx : feat_indices) {
-        const Feature::Ptr& feat_i = curr_frame->feats_[idx];
-        // Only consider unmatched features.
-        if (!feat_i->point_.expired()) continue;
-        const int dist = matcher_utils::computeDescDist(
-            point->best_feat_->descriptor_, feat_i->descriptor_);
+      for (int k = 0, k_end = feat_indices.size(); k < k_end; ++k) {
+        const int idx = feat_indices[k];
+        // Only consider features unmatched before this searching.
+        if (curr_frame->is_linked_[idx]) continue;
+        const int dist = dists[k];
         if (dist < min_dist) {
           second_min_dist = min_dist;
           min_dist = dist;
           second_best_level = best_level;
-          best_level = feat_i->level_;
+          best_level = curr_frame->levels_[idx];
           best_idx = idx;
         } else if (dist < second_min_dist) {
           second_min_dist = dist;
-          second_best_level = feat_i->level_;
+          second_best_level = curr_frame->levels_[idx];
         }
       }
 
       // Perform thresholding, distance ratio test, and scale consistency test,
-      if (min_dist >= Config::match_thresh_relax() ||
+      if (min_dist >= Desc::scaleThresh(Config::match_thresh_relax()) ||
           min_dist >= Config::dist_ratio_test_factor() * second_min_dist)
         // ||
         // best_level != second_best_level)
         continue;
-
-      // Update linked map point.
-      //! Currently the point is associated with the feature and the frame but
-      //! the observation information of the point is not updated yet. (It will
-      //! be updated by the local mapper).
-      curr_frame->feats_[best_idx]->point_ = point;
-      ++n_matches;
+      best_indices[j] = best_idx;
+      best_dists[j] = min_dist;
     }
+  });
+
+  // Resolve conflicts, i.e. several points claiming the same feature: the
+  // point with the least distance wins and ties are broken by the least map
+  // point id. Hence the result depends neither on the number of threads nor
+  // on the order the points are gathered in.
+  vector<int>& claims = ws.claims;  // Indices into visible.
+  claims.assign(curr_frame->nObs(), -1);
+  const auto point_id = [&local_points](const int j) {
+    return local_points.points[local_points.visible[j]]->id_;
+  };
+  for (int j = 0; j < n_visible; ++j) {
+    const int idx = best_indices[j];
+    if (idx < 0) continue;
+    const int k = claims[idx];
+    if (k < 0 || best_dists[j] < best_dists[k] ||
+        (best_dists[j] == best_dists[k] && point_id(j) < point_id(k)))
+      claims[idx] = j;
+  }
+  for (int idx = 0, n_obs = claims.size(); idx < n_obs; ++idx) {
+    if (claims[idx] < 0) continue;
+    // Update linked map point.
+    //! Currently the point is associated with the feature and the frame but
+    //! the observation information of the point is not updated yet. (It will
+    //! be updated by the local mapper).
+    feat_utils::linkPoint(
+        curr_frame->feats_[idx],
+        local_points.points[local_points.visible[claims[idx]]]);
+    ++n_matches;
   }
-  // Reset the marker making it ready for the next searching.
-  std::for_each(
-      shared_points.cbegin(), shared_points.cend(),
-      [](const MapPoint::Ptr& point) { point->curr_tracked_frame_id_ = -1; });
   return n_matches;
 }
 
-int Matcher::searchByBoW(const Frame::Ptr& keyframe, const Frame::Ptr& frame,
-                         vector<int>& matches) {
+}  // namespace
+
+template <typename Desc>
+int BasicMatcher<Desc>::searchByBoW(const Frame::Ptr& keyframe,
+                                    const Frame::Ptr& frame,
+                                    MatchList& matches, MatchWorkspace& ws) {
+  CHECK_EQ(frame->descriptors_.cols, Desc::kBytes);
   const vector<Feature::Ptr>& feats_kf = keyframe->feats_;
-  const vector<Feature::Ptr>& feats_f = frame->feats_;
-  const int n_feats_kf = feats_kf.size(), n_feats_f = feats_f.size();
-  matches.assign(n_feats_kf, -1);  // -1 denotes no matching.
+  matches.clear();
   // Record as well reverse matches to preclude repeat matching.
-  vector<bool> matched(n_feats_f, false);
+  vector<std::uint8_t>& matched = ws.matched;
+  matched.assign(frame->feats_.size(), false);
 
-  int n_matches = 0;
+  // Descriptor distances against features in the node.
+  vector<int>& dists = ws.dists;
   // Searching feature matches by utilizing feature vectors formed by vocabulary
-  // tree.
-  auto it_kf = keyframe->feat_vec_.cbegin(),
-       it_kf_end = keyframe->feat_vec_.cend(), it_f = frame->feat_vec_.cbegin(),
-       it_f_end = frame->feat_vec_.cend();
-  // Perform searching till exhausted.
-  while (it_kf != it_kf_end && it_f != it_f_end) {
-    // Search feature matches in the same node.
-    if (it_kf->first == it_f->first) {
-      // Each node in the vocabulary contains indices of feature descriptors of
-      // the correponding features detected in the frame.
-      const vector<unsigned int>& indices_kf = it_kf->second;
-      const vector<unsigned int>& indices_f = it_f->second;
-
-      for (const int idx_kf : indices_kf) {
-        const Feature::Ptr& feat_kf = feats_kf[idx_kf];
-        const MapPoint::Ptr& point = feat_utils::getPoint(feat_kf);
-        // Since we're searching for 3D-2D matches, the corresponding point of
-        // this feature must be valid.
-        if (!point) continue;
-
-        // Search feature matches between the feature in keyframe and all
-        // features in frame.
-        int min_dist = 256, second_min_dist = 256;
-        int best_idx_f = 0;
-        for (const int idx_f : indices_f) {
-          if (matched[idx_f]) continue;  // Avoid repeat matching.
-          const int dist = matcher_utils::computeDescDist(
-              feats_kf[idx_kf]->descriptor_, feats_f[idx_f]->descriptor_);
-          if (dist < min_dist) {
-            second_min_dist = dist;
-            min_dist = dist;
-            best_idx_f = idx_f;
-          } else if (dist < second_min_dist)
-            second_min_dist = dist;
+  // tree, i.e. only features falling in the same node are compared.
+  const FlatFeatureVector &feat_vec_kf = keyframe->feat_vec_,
+                          &feat_vec_f = frame->feat_vec_;
+  FlatFeatureVector::join(
+      feat_vec_kf, feat_vec_f,
+      [&](const FlatFeatureVector::Node& node_kf,
+          const FlatFeatureVector::Node& node_f) {
+        // Each node in the vocabulary contains indices of feature descriptors
+        // of the correponding features detected in the frame.
+        const unsigned int* indices_f = feat_vec_f.first(node_f);
+        const int n_indices_f = feat_vec_f.count(node_f);
+
+        for (const unsigned int* it = feat_vec_kf.first(node_kf),
+                                *it_end = feat_vec_kf.last(node_kf);
+             it != it_end; ++it) {
+          const int idx_kf = *it;
+          const Feature::Ptr& feat_kf = feats_kf[idx_kf];
+          const MapPoint::Ptr& point = feat_utils::getPoint(feat_kf);
+          // Since we're searching for 3D-2D matches, the corresponding point
+          // of this feature must be valid.
+          if (!point) continue;
+
+          // Search feature matches between the feature in keyframe and all
+          // features in frame.
+          matcher_utils::computeDescDists<Desc>(keyframe->descriptor(idx_kf),
+                                                frame, indices_f, n_indices_f,
+                                                dists);
+          int min_dist = Desc::kBits, second_min_dist = Desc::kBits;
+          int best_idx_f = 0;
+          for (int k = 0; k < n_indices_f; ++k) {
+            const int idx_f = indices_f[k];
+            if (matched[idx_f]) continue;  // Avoid repeat matching.
+            const int dist = dists[k];
+            if (dist < min_dist) {
+              second_min_dist = min_dist;
+              min_dist = dist;
+              best_idx_f = idx_f;
+            } else if (dist < second_min_dist)
+              second_min_dist = dist;
+          }
+
+          // Apply thresholding test and distance ratio test.
+          if (min_dist >= Desc::scaleThresh(Config::match_thresh_strict()) ||
+              min_dist >= Config::dist_ratio_test_factor() * second_min_dist)
+            continue;
+          matches.emplace_back(idx_kf, best_idx_f);
+          matched[best_idx_f] = true;
         }
+      });
+  return matches.size();
+}
 
-        // Apply thresholding test and distance ratio test.
-        if (min_dist >= Config::match_thresh_strict() ||
-            min_dist >= Config::dist_ratio_test_factor() * second_min_dist)
-          continue;
-        matches[idx_kf] = best_idx_f;
-        matched[best_idx_f] = true;
-        ++n_matches;
-      }
-      ++it_kf;
-      ++it_f;
-    } else if (it_kf->first < it_f->first) {
-      // Align the iterators of keyframe with that of frame.
-      it_kf = frame->feat_vec_.lower_bound(it_f->first);
-    } else {
-      // Align the iterators of frame with that of keyframe.
-      it_f = keyframe->feat_vec_.lower_bound(it_kf->first);
+template <typename Desc>
+int BasicMatcher<Desc>::searchForTriangulation(const Frame::Ptr& keyframe_1,
+                                               const Frame::Ptr& keyframe_2,
+                                               MatchList& matches,
+                                               MatchWorkspace& ws) {
+  CHECK_EQ(keyframe_2->descriptors_.cols, Desc::kBytes);
+  const vector<std::uint8_t>& is_linked_1 = keyframe_1->is_linked_;
+  const vector<std::uint8_t>& is_linked_2 = keyframe_2->is_linked_;
+  const int n_feats_1 = is_linked_1.size(), n_feats_2 = is_linked_2.size();
+  matches.clear();
+  // Record as well reverse matches to preclude repeat matching.
+  vector<std::uint8_t>& matched = ws.matched;
+  matched.assign(n_feats_2, false);
+
+  // Fundamental matrix and epipole in keyframe_2 are computed once per pair.
+  const Mat33 F_2_1 = geometry::getFundamentalByPose(keyframe_1, keyframe_2);
+  const SE3 T_2_1 = keyframe_2->pose() * keyframe_1->pose().inverse();
+  const Vec3 epipole = keyframe_2->cam_->K() * T_2_1.translation();
+
+  // Only consider features not linking a map point yet.
+  vector<int>& indices_2 = ws.unmatched;
+  indices_2.clear();
+  for (int idx_2 = 0; idx_2 < n_feats_2; ++idx_2)
+    if (!is_linked_2[idx_2]) indices_2.push_back(idx_2);
+  matcher_utils::EpipolarIndex& epi_index = ws.epi_index;
+  epi_index.build(keyframe_2, indices_2, epipole);
+
+  const double chi2_thresh = 3.84;  // One degree chi-square p-value;
+  const vector<double>& sigma2s = Config::scale_level_sigma2();
+  const double max_dist = chi2_thresh * sigma2s.back();
+
+  // Features around the epipolar line.
+  vector<unsigned int>& candidates = ws.candidates;
+  // Descriptor distances against the candidates.
+  vector<int>& dists = ws.dists;
+  for (int idx_1 = 0; idx_1 < n_feats_1; ++idx_1) {
+    // Only consider unmatched features.
+    if (is_linked_1[idx_1]) continue;
+    const Vec2& pt_1 = keyframe_1->pts_[idx_1];
+    // Epipolar line in keyframe_2 normalized such that the distance to a point
+    // is given by the dot product.
+    Vec3 epi_line = F_2_1 * pt_1.homogeneous();
+    const double norm = epi_line.head<2>().norm();
+    if (norm == 0.) continue;
+    epi_line /= norm;
+
+    // Search feature matches in the band around the epipolar line, skipping
+    // those features having matched before.
+    candidates.clear();
+    epi_index.searchBand(epi_line, max_dist, candidates);
+    candidates.erase(
+        std::remove_if(candidates.begin(), candidates.end(),
+                       [&](const unsigned int idx_2) {
+                         if (matched[idx_2]) return true;
+                         const double dist = std::abs(epi_line.dot(
+                             keyframe_2->pts_[idx_2].homogeneous()));
+                         return dist >= chi2_thresh *
+                                            sigma2s[keyframe_2->levels_[idx_2]];
+                       }),
+        candidates.end());
+    if (candidates.empty()) continue;
+    matcher_utils::computeDescDists<Desc>(keyframe_1->descriptor(idx_1),
+                                          keyframe_2, candidates, dists);
+    int min_dist = Desc::kBits, second_min_dist = Desc::kBits;
+    int best_idx_2 = 0;
+    for (int k = 0, k_end = candidates.size(); k < k_end; ++k) {
+      const int dist = dists[k];
+      if (dist < min_dist) {
+        second_min_dist = min_dist;
+        min_dist = dist;
+        best_idx_2 = candidates[k];
+      } else if (dist < second_min_dist)
+        second_min_dist = dist;
     }
+
+    // Apply thresholding test, distance ratio test and epipolar constraint
+    // test in keyframe_1.
+    if (min_dist >= Desc::scaleThresh(Config::match_thresh_strict()) ||
+        min_dist >= Config::dist_ratio_test_factor() * second_min_dist)
+      continue;
+    const double dist_1 = geometry::pointToEpiLineDist(
+        pt_1, keyframe_2->pts_[best_idx_2], F_2_1, true);
+    if (dist_1 >= chi2_thresh * sigma2s.at(keyframe_1->levels_[idx_1]))
+      continue;
+    matches.emplace_back(idx_1, best_idx_2);
+    matched[best_idx_2] = true;
   }
-  return n_matches;
+  return matches.size();
 }
 
-int Matcher::searchForTriangulation(const Frame::Ptr& keyframe_1,
-                                    const Frame::Ptr& keyframe_2,
-                                    vector<int>& matches) {
-  const vector<Feature::Ptr>& feats_1 = keyframe_1->feats_;
-  const vector<Feature::Ptr>& feats_2 = keyframe_2->feats_;
-  const int n_feats_1 = feats_1.size(), n_feats_2 = feats_2.size();
-  matches.assign(n_feats_1, -1);  // -1 denotes no matching.
-  // Record as well reverse matches to preclude repeat matching.
-  vector<bool> matched(n_feats_2, false);
+namespace matcher_utils {
 
-  int n_matches = 0;
-  // Searching feature matches by utilizing feature vectors formed by vocabulary
-  // tree.
-  auto it_1 = keyframe_1->feat_vec_.cbegin(),
-       it_1_end = keyframe_1->feat_vec_.cend(),
-       it_2 = keyframe_2->feat_vec_.cbegin(),
-       it_2_end = keyframe_2->feat_vec_.cend();
-  // Perform searching till exhausted.
-  while (it_1 != it_1_end && it_2 != it_2_end) {
-    // Search feature matches in the same node.
-    if (it_1->first == it_2->first) {
-      // Each node in the vocabulary contains indices of feature descriptors of
-      // the correponding features detected in the frame.
-      const vector<unsigned int>& indices_1 = it_1->second;
-      const vector<unsigned int>& indices_2 = it_2->second;
-
-      for (const int idx_1 : indices_1) {
-        const Feature::Ptr& feat_1 = feats_1[idx_1];
-        // Only consider unmatched features.
-        if (!feat_1->point_.expired()) continue;
-
-        // Search feature matches between the feature in keyframe_1 and all
-        // features in keyframe_2.
-        int min_dist = 256, second_min_dist = 256;
-        int best_idx_2 = 0;
-        for (const int idx_2 : indices_2) {
-          const Feature::Ptr& feat_2 = feats_2[idx_2];
-          // Skip those features that already link a map point or have matched
-          // before.
-          if (!feat_2->point_.expired() || matched[idx_2]) continue;
-
-          // Compute descriptor distance.
-          const int dist = matcher_utils::computeDescDist(feat_1->descriptor_,
-                                                          feat_2->descriptor_);
-          if (dist < min_dist) {
-            second_min_dist = min_dist;
-            min_dist = dist;
-            best_idx_2 = idx_2;
-          } else if (dist < second_min_dist)
-            second_min_dist = dist;
-        }
+void EpipolarIndex::build(const Frame::Ptr& frame, const vector<int>& indices,
+                          const Vec3& epipole) {
+  //! Rings are cleared rather than removed so as to keep their capacity.
+  for (vector<Entry>& ring : rings_) ring.clear();
+  //! An epipole at infinity, i.e. all epipolar lines are parallel, is
+  //! approximated by a very far one.
+  constexpr double kMinDepth = 1e-9;
+  const double depth = std::abs(epipole.z()) < kMinDepth
+                           ? std::copysign(kMinDepth, epipole.z())
+                           : epipole.z();
+  epipole_ = epipole.head<2>() / depth;
+  center_.setZero();
+  for (const int idx : indices) {
+    center_ += frame->pts_[idx];
+    const Vec2 dir = frame->pts_[idx] - epipole_;
+    const double dist = dir.norm();
+    const int ring = dist < kRingRadius
+                         ? 0
+                         : static_cast<int>(std::log2(dist / kRingRadius)) + 1;
+    if (ring >= static_cast<int>(rings_.size())) rings_.resize(ring + 1);
+    rings_[ring].push_back({lineAngle(dir.x(), dir.y()), idx});
+  }
+  if (!indices.empty()) center_ /= indices.size();
+  for (vector<Entry>& ring : rings_) std::sort(ring.begin(), ring.end());
+}
 
-        // Apply thresholding test, distance ratio test and epipolar constraint
-        // test.
-        if (min_dist >= Config::match_thresh_strict() ||
-            min_dist >= Config::dist_ratio_test_factor() * second_min_dist)
-          continue;
-        const Mat33 F_2_1 =
-            geometry::getFundamentalByPose(keyframe_1, keyframe_2);
-        const Feature::Ptr& feat_2 = feats_2[best_idx_2];
-        const double dist_1 = geometry::pointToEpiLineDist(
-                         feat_1->pt_, feat_2->pt_, F_2_1, true),
-                     dist_2 = geometry::pointToEpiLineDist(
-                         feat_1->pt_, feat_2->pt_, F_2_1, false);
-        const double chi2_thresh = 3.84;  // One degree chi-square p-value;
-        const vector<double>& sigma2s = Config::scale_level_sigma2();
-        if (dist_1 >= chi2_thresh * sigma2s.at(feat_1->level_) ||
-            dist_2 >= chi2_thresh * sigma2s.at(feat_2->level_))
-          continue;
-        matches[idx_1] = best_idx_2;
-        matched[best_idx_2] = true;
-        ++n_matches;
-      }
-      ++it_1;
-      ++it_2;
-    } else if (it_1->first < it_2->first) {
-      // Align the iterators of keyframe_1 with that of keyframe_2.
-      it_1 = keyframe_2->feat_vec_.lower_bound(it_2->first);
-    } else {
-      // Align the iterators of keyframe_2 with that of keyframe_1
-      it_2 = keyframe_1->feat_vec_.lower_bound(it_1->first);
+void EpipolarIndex::searchBand(const Vec3& epi_line, const double max_dist,
+                               vector<unsigned int>& candidates) const {
+  // Angle of the line through the epipole and the point of the epipolar line
+  // closest to the features. Unlike the direction of the epipolar line, this
+  // stays accurate if the epipole is approximated.
+  const Vec2 normal = epi_line.head<2>();
+  const Vec2 foot = center_ - epi_line.dot(center_.homogeneous()) /
+                                  normal.squaredNorm() * normal;
+  const Vec2 dir = foot - epipole_;
+  const double angle = lineAngle(dir.x(), dir.y());
+  for (int k = 0, n_rings = rings_.size(); k < n_rings; ++k) {
+    const vector<Entry>& ring = rings_[k];
+    if (ring.empty()) continue;
+    // A feature at distance d to the epipole whose line makes an angle t with
+    // the epipolar line lies at distance d * sin(t) to the epipolar line.
+    const double inner_radius = k == 0 ? 0. : std::ldexp(kRingRadius, k - 1);
+    if (inner_radius <= max_dist) {
+      for (const Entry& entry : ring) candidates.push_back(entry.idx);
+      continue;
     }
+    const double half_width = std::asin(max_dist / inner_radius);
+    auto append = [&](const double low, const double high) {
+      auto it = std::lower_bound(ring.cbegin(), ring.cend(), Entry{low, 0});
+      auto it_end = std::upper_bound(it, ring.cend(), Entry{high, 0});
+      for (; it != it_end; ++it) candidates.push_back(it->idx);
+    };
+    // Angles wrap around at pi.
+    const double low = angle - half_width, high = angle + half_width;
+    if (low < 0.) {
+      append(0., high);
+      append(low + EIGEN_PI, EIGEN_PI);
+    } else if (high >= EIGEN_PI) {
+      append(low, EIGEN_PI);
+      append(0., high - EIGEN_PI);
+    } else
+      append(low, high);
   }
-  return n_matches;
 }
 
-namespace matcher_utils {
+void LocalPoints::reserve(const int n) {
+  if (n <= positions.cols()) return;
+  const int capacity = std::max<int>(n, 2 * positions.cols());
+  positions.resize(3, capacity);
+  view_dirs.resize(3, capacity);
+  median_scales.resize(capacity);
+  levels.resize(capacity);
+  repr_pts.resize(2, capacity);
+  cos_view_dirs.resize(capacity);
+  points_c.resize(3, capacity);
+  rays.resize(3, capacity);
+  is_visible.resize(capacity);
+  visible.reserve(capacity);
+  descs.resize(capacity);
+}
 
-int computeDescDist(const cv::Mat& desc_1, const cv::Mat& desc_2) {
-  const int* pa = desc_1.ptr<int32_t>();
-  const int* pb = desc_2.ptr<int32_t>();
+namespace {
 
-  int dist = 0;
+// Gather the unique map points observed by the keyframes in [first, last).
+template <typename FrameIt>
+void gatherFrom(FrameIt first, FrameIt last, LocalPoints& local_points) {
+  vector<sptr<MapPoint>>& points = local_points.points;
+  points.clear();
+  // The number of features bounds the number of points.
+  int n_feats = 0;
+  for (FrameIt it = first; it != last; ++it) n_feats += (*it)->nObs();
+  local_points.reserve(n_feats);
 
-  for (int i = 0; i < 8; i++, pa++, pb++) {
-    unsigned int v = *pa ^ *pb;
-    v = v - ((v >> 1) & 0x55555555);
-    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-    dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+  // Points gathered so far.
+  thread_local IdSet is_gathered;
+  is_gathered.reset();
+  for (FrameIt it = first; it != last; ++it) {
+    const Frame::Ptr& kf = *it;
+    const int n_obs = kf->nObs();
+    for (int i = 0; i < n_obs; ++i) {
+      const MapPoint::Ptr& point = feat_utils::getPoint(kf->feats_[i]);
+      if (!point || !is_gathered.insert(point->id_)) continue;
+      const int j = points.size();
+      points.push_back(point);
+      local_points.levels[j] = kf->levels_[i];
+      local_points.positions.col(j) = point->pos();
+      local_points.view_dirs.col(j) = point->median_view_dir_;
+      local_points.median_scales[j] = point->median_view_scale_;
+      local_points.descs[j] = point->descriptor();
+    }
   }
+}
 
-  return dist;
+}  // namespace
+
+ThreadPool& threadPool() {
+  //! The calling thread takes part in the work as well.
+  static ThreadPool thread_pool(Config::n_matcher_threads() - 1);
+  return thread_pool;
+}
+
+void gatherLocalPoints(const unordered_set<Frame::Ptr>& keyframes,
+                       LocalPoints& local_points) {
+  // Gather in the order of keyframe ids rather than the order of the hash set
+  // such that the points and the levels recorded are deterministic.
+  thread_local vector<Frame::Ptr> sorted_kfs;
+  sorted_kfs.assign(keyframes.cbegin(), keyframes.cend());
+  std::sort(sorted_kfs.begin(), sorted_kfs.end(),
+            [](const Frame::Ptr& a, const Frame::Ptr& b) {
+              return a->id_ < b->id_;
+            });
+  gatherFrom(sorted_kfs.cbegin(), sorted_kfs.cend(), local_points);
+  sorted_kfs.clear();  // Not to keep the keyframes alive.
+}
+
+void gatherLocalPoints(const Frame::Ptr& frame, LocalPoints& local_points) {
+  gatherFrom(&frame, &frame + 1, local_points);
+}
+
+void projectLocalPoints(const Frame::Ptr& frame, LocalPoints& local_points) {
+  static const double kMinCosViewDir = std::cos(math_utils::degree2radian(60.));
+  const int n_points = local_points.size();
+  local_points.visible.clear();
+  if (n_points == 0) return;
+
+  const SE3 T_c_w = frame->pose();
+  const Mat33 R = T_c_w.rotationMatrix();
+  const Vec3 t = T_c_w.translation();
+  const Vec3 cam_center = -R.transpose() * t;
+  // Only the first n_points columns are valid. All results are evaluated into
+  // the preallocated arrays.
+  const auto positions = local_points.positions.leftCols(n_points);
+  const auto view_dirs = local_points.view_dirs.leftCols(n_points);
+  auto p_c = local_points.points_c.leftCols(n_points);
+  auto repr_pts = local_points.repr_pts.leftCols(n_points);
+  auto rays = local_points.rays.leftCols(n_points);
+  auto cos_view_dirs = local_points.cos_view_dirs.head(n_points);
+
+  // Transform to camera frame and project.
+  p_c.noalias() = R * positions;
+  p_c.colwise() += t;
+  repr_pts.row(0) =
+      (Camera::fx_ * p_c.row(0).array() / p_c.row(2).array() + Camera::cx_)
+          .matrix();
+  repr_pts.row(1) =
+      (Camera::fy_ * p_c.row(1).array() / p_c.row(2).array() + Camera::cy_)
+          .matrix();
+
+  // Cosine of the angle between the viewing direction from the camera center
+  // and the median viewing direction.
+  rays = positions.colwise() - cam_center;
+  cos_view_dirs =
+      (rays.array() * view_dirs.array()).colwise().sum().transpose() /
+      rays.colwise().norm().transpose().array();
+
+  // Visibility tests evaluated for all points at once.
+  const auto u = repr_pts.row(0).array().transpose();
+  const auto v = repr_pts.row(1).array().transpose();
+  auto is_visible = local_points.is_visible.head(n_points);
+  is_visible =
+      (p_c.row(2).array().transpose() >= 0.) && (u >= Frame::x_min_) &&
+      (u <= Frame::x_max_) && (v >= Frame::y_min_) && (v <= Frame::y_max_) &&
+      ((local_points.levels.head(n_points) -
+        local_points.median_scales.head(n_points))
+           .abs() <= 1) &&
+      (cos_view_dirs >= kMinCosViewDir);
+
+  for (int i = 0; i < n_points; ++i)
+    if (is_visible[i]) local_points.visible.push_back(i);
 }
 
 }  // namespace matcher_utils
+
+template class BasicMatcher<Orb256>;
+template class BasicMatcher<Brisk512>;
+template class BasicMatcher<Akaze486>;
+
 }  // namespace mono_slam
@@ -0,0 +1,144 @@
+#include "mono_slam/matcher/descriptor_index.h"
+
+#include "mono_slam/feature.h"
+#include "mono_slam/matcher.h"
+#include "mono_slam/utils/id_scratch.h"
+
+namespace mono_slam {
+
+void DescriptorIndex::insert(const MapPoint::Ptr& point) {
+  if (!point->hasDescriptor() || point->to_be_deleted_) return;
+  //! Only 256-bit descriptors are indexed.
+  if (point->descriptorBytes() != static_cast<int>(sizeof(Desc256))) return;
+  const Desc256 desc(point->descriptor().data());
+  std::unique_lock<std::shared_mutex> lock(mut_);
+  int slot;
+  auto it = slot_of_point_.find(point->id_);
+  if (it != slot_of_point_.end()) {
+    slot = it->second;
+    eraseSlot(slot);
+  } else if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    slot_of_point_[point->id_] = slot;
+  } else {
+    slot = descs_.size();
+    descs_.emplace_back();
+    points_.emplace_back();
+    slot_of_point_[point->id_] = slot;
+  }
+  descs_[slot] = desc;
+  points_[slot] = point;
+  for (int c = 0; c < kNumChunks; ++c)
+    tables_[c][chunk(desc, c)].push_back(slot);
+}
+
+void DescriptorIndex::erase(const MapPoint::Ptr& point) {
+  std::unique_lock<std::shared_mutex> lock(mut_);
+  auto it = slot_of_point_.find(point->id_);
+  if (it == slot_of_point_.end()) return;
+  eraseSlot(it->second);
+  points_[it->second].reset();
+  free_slots_.push_back(it->second);
+  slot_of_point_.erase(it);
+}
+
+void DescriptorIndex::clear() {
+  std::unique_lock<std::shared_mutex> lock(mut_);
+  descs_.clear();
+  points_.clear();
+  free_slots_.clear();
+  slot_of_point_.clear();
+  for (auto& table : tables_) table.clear();
+}
+
+void DescriptorIndex::eraseSlot(const int slot) {
+  for (int c = 0; c < kNumChunks; ++c) {
+    auto it = tables_[c].find(chunk(descs_[slot], c));
+    if (it == tables_[c].end()) continue;
+    vector<int>& bucket = it->second;
+    // Order within a bucket does not matter.
+    auto it_slot = std::find(bucket.begin(), bucket.end(), slot);
+    if (it_slot == bucket.end()) continue;
+    *it_slot = bucket.back();
+    bucket.pop_back();
+    if (bucket.empty()) tables_[c].erase(it);
+  }
+}
+
+void DescriptorIndex::knnSearch(const cv::Mat& descriptors, const int k,
+                                const int max_dist,
+                                vector<vector<Neighbor>>& neighbors) const {
+  CHECK_EQ(descriptors.cols, 32);
+  const int n_queries = descriptors.rows;
+  neighbors.assign(n_queries, {});
+  if (n_queries == 0 || k <= 0) return;
+  std::shared_lock<std::shared_mutex> lock(mut_);
+  matcher_utils::threadPool().parallelFor(0, n_queries, [&](const int i) {
+    searchOne(Desc256(descriptors.ptr<uchar>(i)), k, max_dist, neighbors[i]);
+  });
+}
+
+void DescriptorIndex::searchOne(const Desc256& query, const int k,
+                                const int max_dist,
+                                vector<Neighbor>& neighbors) const {
+  // Slots compared so far.
+  thread_local IdSet is_compared;
+  is_compared.reset();
+  // Best k candidates (slot, dist) sorted by distance.
+  vector<pair<int, int>> best;
+  best.reserve(k + 1);
+
+  auto probe = [&](const int c, const std::uint16_t key) {
+    auto it = tables_[c].find(key);
+    if (it == tables_[c].end()) return;
+    for (const int slot : it->second) {
+      if (!is_compared.insert(slot)) continue;
+      const int dist = hamming::distance(query, descs_[slot]);
+      if (dist > max_dist) continue;
+      if (static_cast<int>(best.size()) == k && dist >= best.back().second)
+        continue;
+      // Insert while keeping sorted.
+      auto pos = std::upper_bound(
+          best.begin(), best.end(), dist,
+          [](const int d, const pair<int, int>& b) { return d < b.second; });
+      best.insert(pos, {slot, dist});
+      if (static_cast<int>(best.size()) > k) best.pop_back();
+    }
+  };
+
+  for (int r = 0; r <= kChunkBits; ++r) {
+    // Probe the keys at exactly distance r from each substring, by flipping
+    // each combination of r bits enumerated in lexicographic order.
+    for (int c = 0; c < kNumChunks; ++c) {
+      const std::uint16_t key = chunk(query, c);
+      if (r == 0) {
+        probe(c, key);
+        continue;
+      }
+      unsigned int mask = (1u << r) - 1;
+      while (mask < (1u << kChunkBits)) {
+        probe(c, key ^ static_cast<std::uint16_t>(mask));
+        // Next mask having the same number of set bits (Gosper's hack).
+        const unsigned int lowest = mask & -mask;
+        const unsigned int ripple = mask + lowest;
+        mask = (((ripple ^ mask) >> 2) / lowest) | ripple;
+      }
+    }
+    // All entries within this distance have been compared.
+    const int searched_dist = kNumChunks * (r + 1) - 1;
+    if (searched_dist >= max_dist) break;
+    const bool is_full = static_cast<int>(best.size()) == k;
+    if (is_full && best.back().second <= searched_dist) break;
+  }
+
+  neighbors.clear();
+  neighbors.reserve(best.size());
+  for (const pair<int, int>& b : best) {
+    MapPoint::Ptr point = points_[b.first].lock();
+    if (!point || point->to_be_deleted_) continue;
+    neighbors.push_back({std::move(point), b.second});
+  }
+}
+
+}  // namespace mono_slam
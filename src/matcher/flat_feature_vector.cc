@@ -0,0 +1,22 @@
+#include "mono_slam/matcher/flat_feature_vector.h"
+
+#include "DBoW3/DBoW3.h"
+
+namespace mono_slam {
+
+void FlatFeatureVector::assign(const DBoW3::FeatureVector& feat_vec) {
+  clear();
+  nodes_.reserve(feat_vec.size());
+  std::size_t n_indices = 0;
+  for (const auto& node : feat_vec) n_indices += node.second.size();
+  indices_.reserve(n_indices);
+  //! std::map iterates in increasing order of ids, hence nodes_ is sorted.
+  for (const auto& node : feat_vec) {
+    const unsigned int begin = indices_.size();
+    indices_.insert(indices_.end(), node.second.cbegin(), node.second.cend());
+    nodes_.push_back({node.first, begin,
+                      static_cast<unsigned int>(indices_.size())});
+  }
+}
+
+}  // namespace mono_slam
@@ -0,0 +1,251 @@
+#include "mono_slam/matcher/hamming.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MONO_SLAM_HAMMING_X86 1
+#include <immintrin.h>
+#endif
+
+namespace mono_slam {
+namespace hamming {
+
+namespace {
+
+//! Each kernel family provides the three primitives below. The many-to-many
+//! variant is built on top of the one-to-many one.
+using DistFn = int (*)(const std::uint8_t*, const std::uint8_t*);
+using OneToManyFn = void (*)(const std::uint8_t*, const std::uint8_t*,
+                             const std::size_t, const int, int*);
+using OneToIndexedFn = void (*)(const std::uint8_t*, const std::uint8_t*,
+                                const std::size_t, const int*, const int,
+                                int*);
+
+struct Kernels {
+  DistFn distance;
+  OneToManyFn one_to_many;
+  OneToIndexedFn one_to_indexed;
+  const char* name;
+};
+
+//##############################################################################
+// Portable fallback.
+
+//@ref http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+inline int distanceScalar(const std::uint8_t* desc_1,
+                          const std::uint8_t* desc_2) {
+  int dist = 0;
+  for (int i = 0; i < 8; ++i) {
+    std::uint32_t a, b;
+    std::memcpy(&a, desc_1 + 4 * i, 4);
+    std::memcpy(&b, desc_2 + 4 * i, 4);
+    std::uint32_t v = a ^ b;
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+  }
+  return dist;
+}
+
+void oneToManyScalar(const std::uint8_t* query, const std::uint8_t* train,
+                     const std::size_t train_stride, const int n_train,
+                     int* dists) {
+  for (int i = 0; i < n_train; ++i)
+    dists[i] = distanceScalar(query, train + i * train_stride);
+}
+
+void oneToIndexedScalar(const std::uint8_t* query, const std::uint8_t* train,
+                        const std::size_t train_stride, const int* indices,
+                        const int n_indices, int* dists) {
+  for (int i = 0; i < n_indices; ++i)
+    dists[i] = distanceScalar(query, train + indices[i] * train_stride);
+}
+
+#ifdef MONO_SLAM_HAMMING_X86
+
+//##############################################################################
+// POPCNT: four 64-bit population counts per descriptor.
+
+__attribute__((target("popcnt"))) inline int distancePopcnt(
+    const std::uint8_t* desc_1, const std::uint8_t* desc_2) {
+  std::uint64_t a[4], b[4];
+  std::memcpy(a, desc_1, 32);
+  std::memcpy(b, desc_2, 32);
+  return static_cast<int>(
+      _mm_popcnt_u64(a[0] ^ b[0]) + _mm_popcnt_u64(a[1] ^ b[1]) +
+      _mm_popcnt_u64(a[2] ^ b[2]) + _mm_popcnt_u64(a[3] ^ b[3]));
+}
+
+__attribute__((target("popcnt"))) int distancePopcntFn(
+    const std::uint8_t* desc_1, const std::uint8_t* desc_2) {
+  return distancePopcnt(desc_1, desc_2);
+}
+
+__attribute__((target("popcnt"))) void oneToManyPopcnt(
+    const std::uint8_t* query, const std::uint8_t* train,
+    const std::size_t train_stride, const int n_train, int* dists) {
+  for (int i = 0; i < n_train; ++i)
+    dists[i] = distancePopcnt(query, train + i * train_stride);
+}
+
+__attribute__((target("popcnt"))) void oneToIndexedPopcnt(
+    const std::uint8_t* query, const std::uint8_t* train,
+    const std::size_t train_stride, const int* indices, const int n_indices,
+    int* dists) {
+  for (int i = 0; i < n_indices; ++i)
+    dists[i] = distancePopcnt(query, train + indices[i] * train_stride);
+}
+
+//##############################################################################
+// AVX2: nibble lookup table population count (Mula et al.) on the whole
+// 256-bit descriptor at once.
+
+__attribute__((target("avx2"))) inline int distanceAvx2(
+    const __m256i query, const std::uint8_t* desc) {
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2,
+                                       3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+                                       2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i v = _mm256_xor_si256(
+      query, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(desc)));
+  const __m256i lo = _mm256_and_si256(v, low_mask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                      _mm256_shuffle_epi8(lut, hi));
+  // Horizontal sum of the 32 byte counts into four 64-bit lanes.
+  const __m256i sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+  const __m128i sum_2 = _mm_add_epi64(_mm256_castsi256_si128(sum),
+                                      _mm256_extracti128_si256(sum, 1));
+  return static_cast<int>(_mm_cvtsi128_si64(sum_2) +
+                          _mm_extract_epi64(sum_2, 1));
+}
+
+__attribute__((target("avx2"))) void oneToManyAvx2(
+    const std::uint8_t* query, const std::uint8_t* train,
+    const std::size_t train_stride, const int n_train, int* dists) {
+  const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query));
+  for (int i = 0; i < n_train; ++i)
+    dists[i] = distanceAvx2(q, train + i * train_stride);
+}
+
+__attribute__((target("avx2"))) void oneToIndexedAvx2(
+    const std::uint8_t* query, const std::uint8_t* train,
+    const std::size_t train_stride, const int* indices, const int n_indices,
+    int* dists) {
+  const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query));
+  for (int i = 0; i < n_indices; ++i)
+    dists[i] = distanceAvx2(q, train + indices[i] * train_stride);
+}
+
+//##############################################################################
+// AVX-512 VPOPCNTDQ: two descriptors per 512-bit register.
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) inline void distance2Avx512(
+    const __m512i query, const std::uint8_t* desc_1,
+    const std::uint8_t* desc_2, int* dist_1, int* dist_2) {
+  const __m512i train = _mm512_inserti64x4(
+      _mm512_castsi256_si512(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(desc_1))),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(desc_2)), 1);
+  const __m512i cnt = _mm512_popcnt_epi64(_mm512_xor_si512(query, train));
+  // Reduce each 256-bit half separately.
+  const __m256i lo = _mm512_castsi512_si256(cnt);
+  const __m256i hi = _mm512_extracti64x4_epi64(cnt, 1);
+  const __m128i lo_2 = _mm_add_epi64(_mm256_castsi256_si128(lo),
+                                     _mm256_extracti128_si256(lo, 1));
+  const __m128i hi_2 = _mm_add_epi64(_mm256_castsi256_si128(hi),
+                                     _mm256_extracti128_si256(hi, 1));
+  *dist_1 =
+      static_cast<int>(_mm_cvtsi128_si64(lo_2) + _mm_extract_epi64(lo_2, 1));
+  *dist_2 =
+      static_cast<int>(_mm_cvtsi128_si64(hi_2) + _mm_extract_epi64(hi_2, 1));
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) void oneToManyAvx512(
+    const std::uint8_t* query, const std::uint8_t* train,
+    const std::size_t train_stride, const int n_train, int* dists) {
+  const __m512i q = _mm512_broadcast_i64x4(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query)));
+  int i = 0;
+  for (; i + 1 < n_train; i += 2)
+    distance2Avx512(q, train + i * train_stride,
+                    train + (i + 1) * train_stride, &dists[i], &dists[i + 1]);
+  if (i < n_train) dists[i] = distancePopcnt(query, train + i * train_stride);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) void oneToIndexedAvx512(
+    const std::uint8_t* query, const std::uint8_t* train,
+    const std::size_t train_stride, const int* indices, const int n_indices,
+    int* dists) {
+  const __m512i q = _mm512_broadcast_i64x4(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query)));
+  int i = 0;
+  for (; i + 1 < n_indices; i += 2)
+    distance2Avx512(q, train + indices[i] * train_stride,
+                    train + indices[i + 1] * train_stride, &dists[i],
+                    &dists[i + 1]);
+  if (i < n_indices)
+    dists[i] = distancePopcnt(query, train + indices[i] * train_stride);
+}
+
+#endif  // MONO_SLAM_HAMMING_X86
+
+int distanceScalarFn(const std::uint8_t* desc_1, const std::uint8_t* desc_2) {
+  return distanceScalar(desc_1, desc_2);
+}
+
+Kernels selectKernels() {
+#ifdef MONO_SLAM_HAMMING_X86
+  __builtin_cpu_init();
+  //! A single pair is cheapest with four scalar popcounts, hence the vector
+  //! kernels are only used for the batch variants.
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vpopcntdq"))
+    return {distancePopcntFn, oneToManyAvx512, oneToIndexedAvx512,
+            "avx512vpopcntdq"};
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    return {distancePopcntFn, oneToManyAvx2, oneToIndexedAvx2, "avx2"};
+  if (__builtin_cpu_supports("popcnt"))
+    return {distancePopcntFn, oneToManyPopcnt, oneToIndexedPopcnt, "popcnt"};
+#endif
+  return {distanceScalarFn, oneToManyScalar, oneToIndexedScalar, "scalar"};
+}
+
+inline const Kernels& kernels() {
+  static const Kernels kernels = selectKernels();
+  return kernels;
+}
+
+}  // namespace
+
+int distance(const std::uint8_t* desc_1, const std::uint8_t* desc_2) {
+  return kernels().distance(desc_1, desc_2);
+}
+
+void distanceOneToMany(const std::uint8_t* query, const std::uint8_t* train,
+                       const std::size_t train_stride, const int n_train,
+                       int* dists) {
+  kernels().one_to_many(query, train, train_stride, n_train, dists);
+}
+
+void distanceOneToIndexed(const std::uint8_t* query,
+                          const std::uint8_t* train,
+                          const std::size_t train_stride, const int* indices,
+                          const int n_indices, int* dists) {
+  kernels().one_to_indexed(query, train, train_stride, indices, n_indices,
+                           dists);
+}
+
+void distanceManyToMany(const std::uint8_t* query,
+                        const std::size_t query_stride, const int n_query,
+                        const std::uint8_t* train,
+                        const std::size_t train_stride, const int n_train,
+                        int* dists) {
+  const OneToManyFn one_to_many = kernels().one_to_many;
+  for (int i = 0; i < n_query; ++i)
+    one_to_many(query + i * query_stride, train, train_stride, n_train,
+                dists + i * n_train);
+}
+
+const char* kernelName() { return kernels().name; }
+
+}  // namespace hamming
+}  // namespace mono_slam
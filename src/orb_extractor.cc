@@ -0,0 +1,299 @@
+#include "mono_slam/orb_extractor.h"
+
+namespace mono_slam {
+
+ORBExtractor::ORBExtractor(const int n_feats, const double scale_factor,
+                           const int n_levels, const int fast_thresh_init,
+                           const int fast_thresh_min, const int cell_size,
+                           const int n_threads)
+    : n_feats_(n_feats),
+      n_levels_(n_levels),
+      fast_thresh_init_(fast_thresh_init),
+      fast_thresh_min_(fast_thresh_min),
+      cell_size_(cell_size) {
+  CHECK_GT(n_levels_, 0);
+  CHECK_GT(cell_size_, 0);
+  scale_factors_.resize(n_levels_);
+  for (int level = 0; level < n_levels_; ++level)
+    scale_factors_[level] = std::pow(scale_factor, level);
+
+  // Distribute the feature budget over levels proportionally to the area of
+  // each level, i.e. the number of a level is the number of the level below
+  // scaled by 1 / scale_factor.
+  n_feats_per_level_.resize(n_levels_);
+  const double factor = 1. / scale_factor;
+  double n_desired = n_feats_ * (1. - factor) /
+                     (1. - std::pow(factor, static_cast<double>(n_levels_)));
+  int n_assigned = 0;
+  for (int level = 0; level < n_levels_ - 1; ++level) {
+    n_feats_per_level_[level] = static_cast<int>(std::round(n_desired));
+    n_assigned += n_feats_per_level_[level];
+    n_desired *= factor;
+  }
+  n_feats_per_level_[n_levels_ - 1] = std::max(n_feats_ - n_assigned, 0);
+
+  // Precompute the end of each row of the circular patch used to compute
+  // orientation.
+  umax_.resize(kHalfPatchSize + 1);
+  const int v_max = std::floor(kHalfPatchSize * std::sqrt(2.) / 2 + 1);
+  const int v_min = std::ceil(kHalfPatchSize * std::sqrt(2.) / 2);
+  const double hp2 = kHalfPatchSize * kHalfPatchSize;
+  for (int v = 0; v <= v_max; ++v)
+    umax_[v] = static_cast<int>(std::round(std::sqrt(hp2 - v * v)));
+  // Make sure the patch is symmetric.
+  for (int v = kHalfPatchSize, v0 = 0; v >= v_min; --v) {
+    while (umax_[v0] == umax_[v0 + 1]) ++v0;
+    umax_[v] = v0;
+    ++v0;
+  }
+
+  pyramid_.resize(n_levels_);
+  descriptor_extractors_.reserve(n_levels_);
+  for (int level = 0; level < n_levels_; ++level)
+    descriptor_extractors_.push_back(cv::ORB::create(
+        n_feats_, static_cast<float>(scale_factor), 1, kEdgeThresh, 0, 2,
+        cv::ORB::FAST_SCORE, kPatchSize, fast_thresh_init_));
+
+  //! The calling thread takes part in the work as well.
+  thread_pool_.reset(new ThreadPool(n_threads - 1));
+}
+
+void ORBExtractor::detectAndCompute(const cv::Mat& img_gray,
+                                    vector<cv::KeyPoint>& kpts,
+                                    cv::Mat& descriptors) {
+  CHECK_EQ(img_gray.type(), CV_8UC1);
+  buildPyramid(img_gray);
+
+  // Detect keypoints in parallel with rows of cells as the unit of work.
+  vector<std::pair<int, int>> cell_rows;  // (level, row)
+  for (int level = 0; level < n_levels_; ++level) {
+    const int height = pyramid_[level].rows - 2 * kEdgeThresh;
+    const int n_rows = std::max(height / cell_size_, 1);
+    for (int row = 0; row < n_rows; ++row) cell_rows.emplace_back(level, row);
+  }
+  vector<vector<cv::KeyPoint>> cell_row_kpts(cell_rows.size());
+  thread_pool_->parallelFor(0, cell_rows.size(), [&](const int i) {
+    detectInCellRow(cell_rows[i].first, cell_rows[i].second, cell_row_kpts[i]);
+  });
+
+  vector<vector<cv::KeyPoint>> level_kpts(n_levels_);
+  for (std::size_t i = 0; i < cell_rows.size(); ++i) {
+    vector<cv::KeyPoint>& dst = level_kpts[cell_rows[i].first];
+    dst.insert(dst.end(), cell_row_kpts[i].cbegin(), cell_row_kpts[i].cend());
+  }
+
+  // Distribute, orient and describe keypoints of each level in parallel.
+  vector<cv::Mat> level_descriptors(n_levels_);
+  thread_pool_->parallelFor(0, n_levels_, [&](const int level) {
+    processLevel(level, level_kpts[level], level_descriptors[level]);
+  });
+
+  kpts.clear();
+  int n_kpts = 0;
+  for (const vector<cv::KeyPoint>& l_kpts : level_kpts)
+    n_kpts += l_kpts.size();
+  kpts.reserve(n_kpts);
+  descriptors.create(n_kpts, 32, CV_8U);
+  int row = 0;
+  for (int level = 0; level < n_levels_; ++level) {
+    if (level_kpts[level].empty()) continue;
+    kpts.insert(kpts.end(), level_kpts[level].cbegin(),
+                level_kpts[level].cend());
+    level_descriptors[level].copyTo(
+        descriptors.rowRange(row, row + level_descriptors[level].rows));
+    row += level_descriptors[level].rows;
+  }
+}
+
+void ORBExtractor::buildPyramid(const cv::Mat& img_gray) {
+  pyramid_[0] = img_gray;
+  for (int level = 1; level < n_levels_; ++level) {
+    const cv::Size size(
+        static_cast<int>(std::round(img_gray.cols / scale_factors_[level])),
+        static_cast<int>(std::round(img_gray.rows / scale_factors_[level])));
+    //! Frames keep the pyramid they are extracted from, hence fresh buffers
+    //! instead of overwriting those of last frame.
+    pyramid_[level].release();
+    cv::resize(pyramid_[level - 1], pyramid_[level], size, 0, 0,
+               cv::INTER_LINEAR);
+  }
+}
+
+void ORBExtractor::detectInCellRow(const int level, const int row,
+                                   vector<cv::KeyPoint>& kpts) const {
+  const cv::Mat& img = pyramid_[level];
+  //! FAST discards 3 pixels on each border of the image it runs on, hence
+  //! cells are enlarged by 3 pixels on each side to be covered entirely.
+  const int min_border = kEdgeThresh - 3;
+  const int max_border_x = img.cols - kEdgeThresh + 3;
+  const int max_border_y = img.rows - kEdgeThresh + 3;
+  const int width = max_border_x - min_border - 6;
+  const int height = max_border_y - min_border - 6;
+  if (width <= 0 || height <= 0) return;
+  const int n_cols = std::max(width / cell_size_, 1);
+  const int n_rows = std::max(height / cell_size_, 1);
+  const int cell_w = std::ceil(static_cast<double>(width) / n_cols);
+  const int cell_h = std::ceil(static_cast<double>(height) / n_rows);
+
+  const int ini_y = min_border + row * cell_h;
+  const int max_y = std::min(ini_y + cell_h + 6, max_border_y);
+  if (ini_y >= max_border_y - 6) return;
+
+  vector<cv::KeyPoint> cell_kpts;
+  for (int col = 0; col < n_cols; ++col) {
+    const int ini_x = min_border + col * cell_w;
+    const int max_x = std::min(ini_x + cell_w + 6, max_border_x);
+    if (ini_x >= max_border_x - 6) continue;
+    const cv::Mat cell = img.rowRange(ini_y, max_y).colRange(ini_x, max_x);
+    cv::FAST(cell, cell_kpts, fast_thresh_init_, true);
+    // Lower the threshold if the cell is textureless.
+    if (cell_kpts.empty()) cv::FAST(cell, cell_kpts, fast_thresh_min_, true);
+    for (cv::KeyPoint& kpt : cell_kpts) {
+      kpt.pt.x += ini_x;
+      kpt.pt.y += ini_y;
+      kpts.push_back(kpt);
+    }
+  }
+}
+
+void ORBExtractor::processLevel(const int level, vector<cv::KeyPoint>& kpts,
+                                cv::Mat& descriptors) const {
+  const cv::Mat& img = pyramid_[level];
+  kpts = orb_utils::distributeQuadtree(
+      kpts, kEdgeThresh, img.cols - kEdgeThresh, kEdgeThresh,
+      img.rows - kEdgeThresh, n_feats_per_level_[level]);
+  if (kpts.empty()) return;
+
+  for (cv::KeyPoint& kpt : kpts) {
+    kpt.angle = orb_utils::computeOrientation(img, kpt.pt, umax_);
+    kpt.size = kPatchSize;
+    kpt.octave = 0;  // The extractor of each level sees a single level.
+  }
+  descriptor_extractors_[level]->compute(img, kpts, descriptors);
+
+  // Scale keypoints back to level 0.
+  const float scale = scale_factors_[level];
+  for (cv::KeyPoint& kpt : kpts) {
+    kpt.pt *= scale;
+    kpt.size *= scale;
+    kpt.octave = level;
+  }
+}
+
+namespace orb_utils {
+
+namespace {
+
+struct QuadNode {
+  float min_x, max_x, min_y, max_y;
+  vector<cv::KeyPoint> kpts;
+};
+
+}  // namespace
+
+vector<cv::KeyPoint> distributeQuadtree(const vector<cv::KeyPoint>& kpts,
+                                        const float min_x, const float max_x,
+                                        const float min_y, const float max_y,
+                                        const int n_desired) {
+  if (kpts.empty() || n_desired <= 0) return {};
+
+  vector<QuadNode> nodes;
+  // Splittable nodes with the most keypoints on top.
+  std::priority_queue<std::pair<int, int>> splittable;
+  int n_leaves = 0;  // Number of nodes having keypoints.
+  auto addNode = [&](QuadNode&& node) {
+    if (node.kpts.empty()) return;
+    ++n_leaves;
+    nodes.push_back(std::move(node));
+    const QuadNode& added = nodes.back();
+    if (added.kpts.size() > 1 && added.max_x - added.min_x > 1.f)
+      splittable.emplace(added.kpts.size(), nodes.size() - 1);
+  };
+
+  // Initial nodes are roughly square vertical strips.
+  const int n_init = std::max(
+      static_cast<int>(std::round((max_x - min_x) / (max_y - min_y))), 1);
+  const float init_w = (max_x - min_x) / n_init;
+  vector<QuadNode> init_nodes(n_init);
+  for (int i = 0; i < n_init; ++i)
+    init_nodes[i] = {min_x + i * init_w, min_x + (i + 1) * init_w, min_y,
+                     max_y, {}};
+  for (const cv::KeyPoint& kpt : kpts) {
+    const int i = std::min(
+        std::max(static_cast<int>((kpt.pt.x - min_x) / init_w), 0),
+        n_init - 1);
+    init_nodes[i].kpts.push_back(kpt);
+  }
+  for (QuadNode& node : init_nodes) addNode(std::move(node));
+
+  // Split the most crowded node till enough nodes are available.
+  while (n_leaves < n_desired && !splittable.empty()) {
+    const int idx = splittable.top().second;
+    splittable.pop();
+    QuadNode parent = std::move(nodes[idx]);
+    nodes[idx].kpts.clear();
+    --n_leaves;
+    const float mid_x = (parent.min_x + parent.max_x) / 2.f;
+    const float mid_y = (parent.min_y + parent.max_y) / 2.f;
+    QuadNode children[4] = {
+        {parent.min_x, mid_x, parent.min_y, mid_y, {}},
+        {mid_x, parent.max_x, parent.min_y, mid_y, {}},
+        {parent.min_x, mid_x, mid_y, parent.max_y, {}},
+        {mid_x, parent.max_x, mid_y, parent.max_y, {}}};
+    for (const cv::KeyPoint& kpt : parent.kpts)
+      children[(kpt.pt.x >= mid_x) + 2 * (kpt.pt.y >= mid_y)].kpts.push_back(
+          kpt);
+    for (QuadNode& child : children) addNode(std::move(child));
+  }
+
+  // Retain the keypoint with the highest response of each node.
+  vector<cv::KeyPoint> distributed_kpts;
+  distributed_kpts.reserve(n_leaves);
+  for (const QuadNode& node : nodes) {
+    if (node.kpts.empty()) continue;
+    distributed_kpts.push_back(*std::max_element(
+        node.kpts.cbegin(), node.kpts.cend(),
+        [](const cv::KeyPoint& kpt_1, const cv::KeyPoint& kpt_2) {
+          return kpt_1.response < kpt_2.response;
+        }));
+  }
+  //! The last split may overshoot the budget by at most 3 nodes.
+  if (static_cast<int>(distributed_kpts.size()) > n_desired) {
+    std::nth_element(distributed_kpts.begin(),
+                     distributed_kpts.begin() + n_desired,
+                     distributed_kpts.end(),
+                     [](const cv::KeyPoint& kpt_1, const cv::KeyPoint& kpt_2) {
+                       return kpt_1.response > kpt_2.response;
+                     });
+    distributed_kpts.resize(n_desired);
+  }
+  return distributed_kpts;
+}
+
+float computeOrientation(const cv::Mat& img, const cv::Point2f& pt,
+                         const vector<int>& umax) {
+  const int half_patch_size = static_cast<int>(umax.size()) - 1;
+  const uchar* center = &img.at<uchar>(static_cast<int>(std::round(pt.y)),
+                                       static_cast<int>(std::round(pt.x)));
+  const int step = static_cast<int>(img.step1());
+  int m_01 = 0, m_10 = 0;
+  // The center row is treated separately.
+  for (int u = -half_patch_size; u <= half_patch_size; ++u)
+    m_10 += u * center[u];
+  // The rows above and below the center row are processed in pairs.
+  for (int v = 1; v <= half_patch_size; ++v) {
+    int v_sum = 0;
+    const int d = umax[v];
+    for (int u = -d; u <= d; ++u) {
+      const int val_plus = center[u + v * step];
+      const int val_minus = center[u - v * step];
+      v_sum += val_plus - val_minus;
+      m_10 += u * (val_plus + val_minus);
+    }
+    m_01 += v * v_sum;
+  }
+  return cv::fastAtan2(static_cast<float>(m_01), static_cast<float>(m_10));
+}
+
+}  // namespace orb_utils
+}  // namespace mono_slam
@@ -16,6 +16,7 @@ class Camera;
 double Camera::fx_, Camera::fy_, Camera::cx_, Camera::cy_;
 Mat33 Camera::K_;
 Vec4 Camera::dist_coeffs_;
+cv::Mat Camera::undist_map_;
 
 System::System(const string& config_file) : config_file_(config_file) {}
 
@@ -37,7 +38,8 @@ bool System::init() {
   const double& img_resize_factor = config["img_resize_factor"];
   const int& img_start_idx = config["img_start_idx"];
   dataset_.reset(new Dataset(dataset_path, img_file_name_fmt, img_resize_factor,
-                             img_start_idx));
+                             img_start_idx, Config::dataset_n_prefetch(),
+                             Config::dataset_n_decode_threads()));
 
   // Load vocabulary.
   const string& voc_file = config["voc_file"];
@@ -93,6 +95,12 @@ bool System::init() {
   Camera::K_ = (Mat33() << fx, 0., cx, 0., fy, cy, 0., 0., 1.).finished();
   Camera::dist_coeffs_ = dist_coeffs;
 
+  // Precompute undistortion lookup table and image bounds shared by all
+  // frames.
+  const cv::Size img_size = dataset_->imageSize();
+  Camera::initUndistortMap(img_size);
+  Frame::initImageBounds(img_size);
+
   // Get camera fps.
   const double& fps = config["fps"];
 
@@ -142,9 +150,9 @@ void System::run() {
   LOG(INFO) << "Tracker is running ...";
   // If timestamp file is not provided, the tracking is performed without any
   // delay.
-  // TODO(bayes) Catch empty image exception and exit system.
+  cv::Mat img;
   if (timestamps_.empty())
-    for (;;) tracker_->addImage(dataset_->nextImage());
+    while (dataset_->nextImage(img)) tracker_->addImage(img);
   else {  // Otherwise, necessary time delay is adopted.
     const int n_images = timestamps_.size();
     // Simply discard the last image for the sake of simplicity.
@@ -152,7 +160,8 @@ void System::run() {
       const steady_clock::time_point t1 = steady_clock::now();
 
       // Track one image.
-      tracker_->addImage(dataset_->nextImage());
+      if (!dataset_->nextImage(img)) break;
+      tracker_->addImage(img);
 
       const steady_clock::time_point t2 = steady_clock::now();
       const double consumed_time =
@@ -164,6 +173,8 @@ void System::run() {
         std::this_thread::sleep_for(duration<double>(delta_t - consumed_time));
     }
   }
+  // Track the frames still being preprocessed.
+  tracker_->flush();
   LOG(INFO) << "Exit system.";
 }
 
@@ -3,6 +3,8 @@
 #include "mono_slam/g2o_optimizer.h"
 #include "mono_slam/geometry_solver.h"
 #include "mono_slam/matcher.h"
+#include "mono_slam/matcher/hamming.h"
+#include "opencv2/video/tracking.hpp"
 
 namespace mono_slam {
 
@@ -10,14 +12,49 @@ class Optimizer;
 
 Tracking::Tracking() : state_(State::NOT_INITIALIZED_YET) {
   initializer_.reset(new Initializer());
-  detector_ = cv::ORB::create(Config::max_n_feats());
+  extractor_.reset(new ORBExtractor(
+      Config::max_n_feats(), Config::scale_factor(), Config::scale_n_levels(),
+      Config::fast_thresh_init(), Config::fast_thresh_min(),
+      Config::extractor_cell_size(), Config::n_extractor_threads()));
+  preprocessor_.reset(new ThreadPool(1));
+  LOG(INFO) << "Hamming distance kernel: " << hamming::kernelName();
 }
 
 void Tracking::addImage(const cv::Mat& img) {
-  // Create a new frame and preprocess it.
-  curr_frame_.reset(new Frame(img));
-  extractFeatures();
-  computeBoW();
+  //! img is captured by value such that its data is kept alive till the frame
+  //! is created.
+  pending_frames_.push_back(
+      preprocessor_->enqueue([this, img]() { return preprocess(img); }));
+  // Bound the number of frames in flight.
+  while (static_cast<int>(pending_frames_.size()) >
+         std::max(Config::pipeline_depth(), 0)) {
+    const Frame::Ptr frame = pending_frames_.front().get();
+    pending_frames_.pop_front();
+    track(frame);
+  }
+}
+
+void Tracking::flush() {
+  while (!pending_frames_.empty()) {
+    const Frame::Ptr frame = pending_frames_.front().get();
+    pending_frames_.pop_front();
+    track(frame);
+  }
+}
+
+Frame::Ptr Tracking::preprocess(const cv::Mat& img) {
+  Frame::Ptr frame(new Frame(img));
+  // Features are extracted on demand while tracking if optical flow tracking
+  // is enabled.
+  if (!Config::use_klt_tracking()) extractFeatures(frame);
+  return frame;
+}
+
+void Tracking::track(const Frame::Ptr& frame) {
+  // Map points linked to the frames being tracked are not released by the
+  // local mapper till the tracking of this frame is done.
+  const EpochManager::Guard epoch_guard = map_->pinEpoch();
+  curr_frame_ = frame;
   trackCurrentFrame();
   // This could only happen when relocalization was failed just now.
   if (curr_frame_ == nullptr) return;
@@ -36,6 +73,11 @@ void Tracking::addImage(const cv::Mat& img) {
   // Since viewer is racing the last_frame_ and curr_frame_, a lock is
   // employed to protect the shared data.
   lock_g lock(mut_);
+  // Images of the frame being replaced are not needed any more. Frames held by
+  // the initializer are kept intact till the map is initialized.
+  if (last_frame_ && last_frame_ != curr_frame_ &&
+      state_ != State::NOT_INITIALIZED_YET)
+    last_frame_->releaseImages();
   last_frame_ = curr_frame_;  // Update last frame.
   // FIXME why calling this delete the keyframe? \see viewer.
   // curr_frame_.reset();       // Reseat pointer making it ready for next frame.
@@ -43,8 +85,10 @@ void Tracking::addImage(const cv::Mat& img) {
 }
 
 void Tracking::trackCurrentFrame() {
+  const bool use_klt = Config::use_klt_tracking();
   switch (state_) {
     case State::NOT_INITIALIZED_YET:
+      if (use_klt) extractFeatures(curr_frame_);
       initializer_->setTracker(shared_from_this());
       if (initMap()) {
         last_kf_id_ = curr_frame_->id_;
@@ -60,6 +104,9 @@ void Tracking::trackCurrentFrame() {
       break;
 
     case State::GOOD:
+      // Frames tracked by optical flow are never selected as keyframes.
+      if (use_klt && trackFromOpticalFlow()) break;
+      if (use_klt) extractFeatures(curr_frame_);
       if (!trackFromLastFrame() || !trackFromLocalMap())
         state_ = State::LOST;
       else {
@@ -73,6 +120,7 @@ void Tracking::trackCurrentFrame() {
       break;
 
     case State::LOST:
+      if (use_klt) extractFeatures(curr_frame_);
       if (relocalization()) {
         last_kf_id_ = curr_frame_->id_;
         curr_frame_->setKeyframe();
@@ -117,6 +165,77 @@ bool Tracking::trackFromLastFrame() {
   return true;
 }
 
+bool Tracking::trackFromOpticalFlow() {
+  LOG(INFO) << "trackFromOpticalFlow ...";
+  // Keyframes need extracted features, hence the frames which may become
+  // keyframes are left to descriptor matching.
+  if (curr_frame_->id_ >= last_kf_id_ + Config::new_kf_interval()) return false;
+  const cv::Mat& last_img = last_frame_->pyramid_[0];
+  const cv::Mat& curr_img = curr_frame_->pyramid_[0];
+  const int n_obs = last_frame_->nObs();
+  if (last_img.empty() ||
+      static_cast<int>(last_frame_->raw_pts_.size()) != n_obs)
+    return false;
+
+  // Propagate the features of last frame observing map points.
+  vector<int> last_indices;
+  vector<cv::Point2f> last_pts;
+  last_indices.reserve(n_obs);
+  last_pts.reserve(n_obs);
+  for (int i = 0; i < n_obs; ++i) {
+    if (!feat_utils::getPoint(last_frame_->feats_[i])) continue;
+    last_indices.push_back(i);
+    last_pts.push_back(last_frame_->raw_pts_[i]);
+  }
+  if (static_cast<int>(last_pts.size()) < Config::min_n_matches()) return false;
+  vector<cv::Point2f> curr_pts;
+  vector<uchar> status;
+  vector<float> errors;
+  cv::calcOpticalFlowPyrLK(
+      last_img, curr_img, last_pts, curr_pts, status, errors,
+      cv::Size(Config::klt_win_size(), Config::klt_win_size()),
+      Config::klt_n_levels() - 1);
+
+  // Features of current frame inherit the level and descriptor of the tracked
+  // ones.
+  const cv::Rect img_rect(0, 0, curr_img.cols, curr_img.rows);
+  vector<cv::KeyPoint> kpts;
+  vector<int> tracked_indices;  // Indices into feats_ of last frame.
+  kpts.reserve(last_pts.size());
+  tracked_indices.reserve(last_pts.size());
+  for (int k = 0, n = last_pts.size(); k < n; ++k) {
+    if (!status[k] || !img_rect.contains(curr_pts[k])) continue;
+    const int i = last_indices[k];
+    //! Size of the ORB patch as the keypoint size which is not used anyway.
+    kpts.emplace_back(curr_pts[k], 31.f, -1.f, 0.f, last_frame_->levels_[i]);
+    tracked_indices.push_back(i);
+  }
+  const int n_tracked = tracked_indices.size();
+  LOG(INFO) << "tracked(last_frame_, curr_frame_) = " << n_tracked;
+  if (n_tracked < Config::min_n_matches()) return false;
+  cv::Mat descriptors(n_tracked, last_frame_->descriptors_.cols, CV_8U);
+  for (int j = 0; j < n_tracked; ++j) {
+    const int i = tracked_indices[j];
+    last_frame_->descriptors_.row(i).copyTo(descriptors.row(j));
+  }
+  setFeatures(curr_frame_, kpts, descriptors);
+  for (int j = 0; j < n_tracked; ++j) {
+    const Feature::Ptr& feat = last_frame_->feats_[tracked_indices[j]];
+    feat_utils::linkPoint(curr_frame_->feats_[j], feat->point_.lock());
+  }
+
+  curr_frame_->setPose(T_curr_last_ * last_frame_->pose());
+  const int n_inlier_matches = Optimizer::optimizePose(curr_frame_);
+  LOG(INFO) << cv::format("trackFromOpticalFlow(n_inlier_matches: %d).",
+                          n_inlier_matches);
+  if (n_inlier_matches < Config::klt_min_n_inlier_matches()) {
+    LOG(INFO) << "trackFromOpticalFlow failed.";
+    return false;
+  }
+  LOG(INFO) << "trackFromOpticalFlow succeeded.";
+  return true;
+}
+
 bool Tracking::trackFromLocalMap() {
   LOG(INFO) << "trackFromLocalMap ...";
   updateLocalCoKfs();
@@ -150,7 +269,8 @@ void Tracking::updateLocalCoKfs() {
   for (const Feature::Ptr& feat_ : curr_frame_->feats_) {
     const MapPoint::Ptr& point = feat_utils::getPoint(feat_);
     if (!point) continue;
-    for (const Feature::Ptr& feat : point->getObservations()) {
+    const MapPoint::ObsSnapshot observations = point->getObservations();
+    for (const Feature::Ptr& feat : *observations) {
       const Frame::Ptr& kf = feat_utils::getKeyframe(feat);
       if (!kf || kf == curr_frame_) continue;  // Self of course is excluded.
       co_kf_weights[kf]++;
@@ -167,8 +287,7 @@ void Tracking::updateLocalCoKfs() {
   //! into it in progress.
   for (const Frame::Ptr& kf_ : unordered_set<Frame::Ptr>(local_co_kfs_)) {
     // Get top 10 keyframes ranked wrt. number of covisible map points.
-    // FIXME How could this frame get co_kfs_ right now?
-    const forward_list<Frame::Ptr>& co_kfs = kf_->getCoKfs(10);
+    const CovisibilityGraph::View co_kfs = map_->co_graph_->getCoKfs(kf_, 10);
     if (co_kfs.empty()) continue;
     for (const Frame::Ptr& kf : co_kfs) {
       if (kf == curr_frame_) continue;
@@ -197,7 +316,7 @@ bool Tracking::needNewKf() {
   LOG(INFO) << "Need new keyframe?";
   bool need_new_kf = true;
   // TODO(bayes) Use a more complicated strategy.
-  const int n_kfs = map_->nKfs();
+  const int n_kfs = map_->getSnapshot()->nKfs();
   LOG(INFO) << n_kfs << " keyframes are in map right now.";
   // Cannot exceed maximal number of keyframes in map at one moment.
   if (n_kfs > Config::max_n_kfs_in_map()) need_new_kf = false;
@@ -216,16 +335,18 @@ bool Tracking::needNewKf() {
 }
 
 bool Tracking::relocalization() {
+  // Bag of words are only computed on demand.
+  curr_frame_->computeBoW(*voc_);
   // Obtain relocalization candidates.
   list<Frame::Ptr> candidate_kfs;
   if (!(map_->kf_db_->detectRelocCandidates(curr_frame_, candidate_kfs)))
-    return false;
+    LOG(INFO) << "Reloc: no candidate keyframe.";
   // Iterate all candidates.
   bool reloc_success = false;
+  // Matches (i, j) from relocalization candidate keyframe to current frame such
+  // that kf[i] = curr_frame_[j].
+  MatchList matches;
   for (const Frame::Ptr& kf : candidate_kfs) {
-    // Matches from relocalization candidate keyframe to current frame such that
-    // kf[i] = curr_frame_[matches[i]];
-    vector<int> matches;
     const int n_matches = Matcher::searchByBoW(kf, curr_frame_, matches);
     LOG(INFO) << "Reloc: matches(kf, curr_frame_) = " << n_matches << '\n';
     if (n_matches <= Config::reloc_min_n_matches()) continue;
@@ -236,13 +357,15 @@ bool Tracking::relocalization() {
     }
     curr_frame_->setPose(relative_pose);
     // Utilize pose graph optimization to count number of inliers.
-    reloc_success = true;
     const int n_inlier_matches = Optimizer::optimizePose(curr_frame_);
-    if (n_inlier_matches < Config::reloc_min_n_inlier_matches()) {
+    if (n_inlier_matches >= Config::reloc_min_n_inlier_matches()) {
       reloc_success = true;
       break;  // Get out from loop once a acceptable candidate is found.
     }
   }
+  // Fall back to matching against all map points only if all candidates
+  // failed.
+  if (!reloc_success) reloc_success = relocalizeAgainstMap();
   if (reloc_success)
     LOG(INFO) << "Relocalization succeeded.";
   else
@@ -250,6 +373,61 @@ bool Tracking::relocalization() {
   return reloc_success;
 }
 
+bool Tracking::relocalizeAgainstMap() {
+  LOG(INFO) << "Reloc: matching against the whole map ...";
+  // The index only holds 256-bit descriptors.
+  if (curr_frame_->descriptors_.cols != static_cast<int>(sizeof(Desc256)))
+    return false;
+  // Two nearest map points of each feature for the distance ratio test.
+  vector<vector<DescriptorIndex::Neighbor>> neighbors;
+  map_->point_index_->knnSearch(curr_frame_->descriptors_, 2,
+                                Config::match_thresh_strict(), neighbors);
+  // Keep the best feature of each map point.
+  unordered_map<MapPoint::Ptr, pair<int, int>> best_of_points;  // (idx, dist)
+  for (int i = 0, n_obs = neighbors.size(); i < n_obs; ++i) {
+    const vector<DescriptorIndex::Neighbor>& nn = neighbors[i];
+    if (nn.empty()) continue;
+    if (nn.size() > 1 &&
+        nn[0].dist >= Config::dist_ratio_test_factor() * nn[1].dist)
+      continue;
+    auto it = best_of_points.find(nn[0].point);
+    if (it == best_of_points.end())
+      best_of_points.insert({nn[0].point, {i, nn[0].dist}});
+    else if (nn[0].dist < it->second.second)
+      it->second = {i, nn[0].dist};
+  }
+  const int n_matches = best_of_points.size();
+  LOG(INFO) << "Reloc: matches(map, curr_frame_) = " << n_matches;
+  if (n_matches <= Config::reloc_min_n_matches()) return false;
+
+  vector<MapPoint::Ptr> points;
+  vector<Feature::Ptr> feats;
+  points.reserve(n_matches);
+  feats.reserve(n_matches);
+  for (const auto& p : best_of_points) {
+    points.push_back(p.first);
+    feats.push_back(curr_frame_->feats_[p.second.first]);
+  }
+  SE3 T_c_w;
+  if (!GeometrySolver::P3PRansac(curr_frame_, points, feats, T_c_w)) {
+    LOG(INFO) << "Reloc: failed to find pose against the map.";
+    return false;
+  }
+  curr_frame_->setPose(T_c_w);
+  // Link the matched map points such that the pose could be optimized.
+  for (int i = 0; i < n_matches; ++i)
+    feat_utils::linkPoint(feats[i], points[i]);
+  const int n_inlier_matches = Optimizer::optimizePose(curr_frame_);
+  LOG(INFO) << "Reloc: inlier matches(map, curr_frame_) = "
+            << n_inlier_matches;
+  if (n_inlier_matches >= Config::reloc_min_n_inlier_matches()) return true;
+  for (const Feature::Ptr& feat : feats) {
+    feat_utils::unlinkPoint(feat);
+    feat->is_outlier_ = false;
+  }
+  return false;
+}
+
 void Tracking::reset() {
   state_ = State::NOT_INITIALIZED_YET;
   initializer_.reset(new Initializer());
@@ -260,33 +438,56 @@ void Tracking::reset() {
   // last_kf_id_ = 0;
 }
 
-void Tracking::extractFeatures() {
+void Tracking::extractFeatures(const Frame::Ptr& frame) {
   vector<cv::KeyPoint> kpts;
-  cv::Mat img_gray;
-  cv::cvtColor(curr_frame_->img_, img_gray, cv::COLOR_BGR2GRAY);
   cv::Mat descriptors;
-  detector_->detectAndCompute(img_gray, cv::noArray(), kpts, descriptors);
-  if (curr_frame_->cam_->distCoeffs()(0) != 0)  // If having distortion.
-    frame_utils::undistortKeypoints(curr_frame_->cam_->K(),
-                                    curr_frame_->cam_->distCoeffs(), kpts);
+  extractor_->detectAndCompute(frame->pyramid_[0], kpts, descriptors);
+  // Keep the pyramid built by the extractor instead of rebuilding it.
+  frame->pyramid_ = extractor_->pyramid();
+  setFeatures(frame, kpts, descriptors);
+}
+
+void Tracking::setFeatures(const Frame::Ptr& frame, vector<cv::KeyPoint>& kpts,
+                           const cv::Mat& descriptors) {
   const int n_kpts = kpts.size();
-  curr_frame_->feats_.reserve(n_kpts);
+  if (Config::use_klt_tracking()) {
+    frame->raw_pts_.resize(n_kpts);
+    for (int i = 0; i < n_kpts; ++i) frame->raw_pts_[i] = kpts[i].pt;
+  }
+  if (Camera::isDistorted()) frame_utils::undistortKeypoints(kpts);
+  //! Features tracked by optical flow may be replaced by extracted ones.
+  frame->pts_.clear();
+  frame->levels_.clear();
+  frame->is_linked_.assign(n_kpts, false);
+  frame->feats_.clear();
+  frame->descriptors_.release();
+  frame->pts_.reserve(n_kpts);
+  frame->levels_.reserve(n_kpts);
+  frame->feats_.reserve(n_kpts);
+  // Features and descriptors are bump-allocated from the frame's arena rather
+  // than allocated one by one.
+  //! The arena is reused if features are set again. Memory of the replaced
+  //! features is only released with the arena, hence stays valid for those
+  //! still holding them.
+  if (!frame->arena_) frame->arena_ = make_shared<Arena>();
+  if (n_kpts > 0) {
+    //! cv::Mat wrapping user data is not reference counted, hence the row
+    //! headers of features are cheap to create and copy.
+    frame->descriptors_ =
+        cv::Mat(n_kpts, descriptors.cols, CV_8U,
+                frame->arena_->allocate(descriptors.total(), 32));
+    descriptors.copyTo(frame->descriptors_);
+  }
+  const ArenaAllocator<Feature> alloc(frame->arena_);
   for (int i = 0; i < n_kpts; ++i) {
-    curr_frame_->feats_.push_back(
-        make_shared<Feature>(curr_frame_, Vec2{kpts[i].pt.x, kpts[i].pt.y},
-                             descriptors.row(i), kpts[i].octave));
+    const Vec2 pt{kpts[i].pt.x, kpts[i].pt.y};
+    frame->pts_.push_back(pt);
+    frame->levels_.push_back(kpts[i].octave);
+    //! Each descriptor is a row header sharing data with descriptors_.
+    frame->feats_.push_back(std::allocate_shared<Feature>(
+        alloc, frame, pt, frame->descriptors_.row(i), kpts[i].octave, i));
   }
-}
-
-void Tracking::computeBoW() {
-  // Collect descriptors into vector as DBoW's command.
-  vector<cv::Mat> descriptor_vec;
-  descriptor_vec.reserve(curr_frame_->nObs());
-  std::transform(curr_frame_->feats_.cbegin(), curr_frame_->feats_.cend(),
-                 std::back_inserter(descriptor_vec),
-                 [](const Feature::Ptr& feat) { return feat->descriptor_; });
-  voc_->transform(descriptor_vec, curr_frame_->bow_vec_, curr_frame_->feat_vec_,
-                  4);
+  frame->assignFeaturesToGrid();
 }
 
 void Tracking::setSystem(sptr<System> system) { system_ = system; }
@@ -0,0 +1,100 @@
+#include "mono_slam/utils/arena.h"
+
+#include <cstdint>  // std::uintptr_t
+#include <cstdlib>  // std::malloc, std::free
+#include <mutex>
+#include <new>  // std::bad_alloc
+
+namespace mono_slam {
+
+namespace {
+
+// Process-wide pool of free blocks of the standard size.
+class BlockPool {
+ public:
+  // Maximum number of blocks retained, i.e. 8 MB.
+  static constexpr std::size_t kMaxNumBlocks = 32;
+
+  static BlockPool& getInstance() {
+    static BlockPool instance;
+    return instance;
+  }
+
+  char* acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mut_);
+      if (!blocks_.empty()) {
+        char* block = blocks_.back();
+        blocks_.pop_back();
+        return block;
+      }
+    }
+    return allocateBlock(Arena::kBlockSize);
+  }
+
+  void release(char* block) {
+    {
+      std::lock_guard<std::mutex> lock(mut_);
+      if (blocks_.size() < kMaxNumBlocks) {
+        blocks_.push_back(block);
+        return;
+      }
+    }
+    std::free(block);
+  }
+
+  static char* allocateBlock(const std::size_t size) {
+    char* block = static_cast<char*>(std::malloc(size));
+    if (!block) throw std::bad_alloc();
+    return block;
+  }
+
+ private:
+  BlockPool() = default;
+
+  ~BlockPool() {
+    for (char* block : blocks_) std::free(block);
+  }
+
+  std::vector<char*> blocks_;
+  std::mutex mut_;
+};
+
+inline char* alignUp(char* ptr, const std::size_t alignment) {
+  const std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(ptr);
+  return reinterpret_cast<char*>((addr + alignment - 1) & ~(alignment - 1));
+}
+
+}  // namespace
+
+Arena::~Arena() {
+  for (const Block& block : blocks_) {
+    if (block.size == kBlockSize)
+      BlockPool::getInstance().release(block.data);
+    else
+      std::free(block.data);
+  }
+}
+
+void* Arena::allocate(const std::size_t n_bytes, const std::size_t alignment) {
+  char* ptr = alignUp(curr_, alignment);
+  if (curr_ && ptr + n_bytes <= end_) {
+    curr_ = ptr + n_bytes;
+    return ptr;
+  }
+  // Large requests get a dedicated block so as not to waste the current one.
+  const std::size_t padded_size = n_bytes + alignment;
+  if (padded_size > kMaxPooledSize) {
+    char* data = BlockPool::allocateBlock(padded_size);
+    //! Keep the current block as the one to bump from.
+    blocks_.insert(blocks_.begin(), {data, padded_size});
+    return alignUp(data, alignment);
+  }
+  char* data = BlockPool::getInstance().acquire();
+  blocks_.push_back({data, kBlockSize});
+  curr_ = alignUp(data, alignment) + n_bytes;
+  end_ = data + kBlockSize;
+  return curr_ - n_bytes;
+}
+
+}  // namespace mono_slam
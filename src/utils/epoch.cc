@@ -0,0 +1,43 @@
+#include "mono_slam/utils/epoch.h"
+
+#include <algorithm>  // std::min
+#include <thread>
+
+namespace mono_slam {
+
+EpochManager::EpochManager() : epoch_(1) {
+  for (std::atomic<std::uint64_t>& slot : pinned_) slot.store(0);
+}
+
+EpochManager::Guard EpochManager::pin() {
+  for (;;) {
+    for (std::atomic<std::uint64_t>& slot : pinned_) {
+      std::uint64_t epoch = epoch_.load();
+      std::uint64_t free = 0;
+      if (!slot.compare_exchange_strong(free, epoch)) continue;
+      // The epoch may have advanced before the slot was published, in which
+      // case a concurrent advance() may have missed this reader. Re-pin till
+      // the pinned epoch is current.
+      for (std::uint64_t curr = epoch_.load(); curr != epoch;
+           curr = epoch_.load()) {
+        epoch = curr;
+        slot.store(epoch);
+      }
+      return Guard(&slot);
+    }
+    //! All slots are taken, which is not expected with the few threads
+    //! reading the map.
+    std::this_thread::yield();
+  }
+}
+
+std::uint64_t EpochManager::advance() {
+  std::uint64_t safe_epoch = epoch_.fetch_add(1) + 1;
+  for (const std::atomic<std::uint64_t>& slot : pinned_) {
+    const std::uint64_t epoch = slot.load();
+    if (epoch != 0) safe_epoch = std::min(safe_epoch, epoch);
+  }
+  return safe_epoch;
+}
+
+}  // namespace mono_slam
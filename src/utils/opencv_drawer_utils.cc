@@ -22,14 +22,15 @@ void OpencvDrawer::drawMatches(const Frame::Ptr& ref_frame,
   auto it = inlier_matches.cbegin(), it_end = inlier_matches.cend();
   for (; it != it_end; ++it)
     matches_ref_curr.push_back(cv::DMatch(it->first, it->second, 0.0f));
-  cv::drawMatches(ref_frame->img_, ref_kpts, curr_frame->img_, curr_kpts,
+  cv::drawMatches(ref_frame->imgForDrawing(), ref_kpts,
+                  curr_frame->imgForDrawing(), curr_kpts,
                   matches_ref_curr, img_show, {255, 0, 0}, {0, 255, 0});
 }
 
 void OpencvDrawer::drawKeyPoints(const Frame::Ptr& frame, cv::Mat& img_show) {
   vector<cv::KeyPoint> kpts;
   opencv_utils::pts2kpts(frame, kpts);
-  cv::drawKeypoints(frame->img_, kpts, img_show, {0, 255, 0});
+  cv::drawKeypoints(frame->imgForDrawing(), kpts, img_show, {0, 255, 0});
 }
 
 namespace opencv_utils {
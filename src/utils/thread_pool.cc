@@ -0,0 +1,74 @@
+#include "mono_slam/utils/thread_pool.h"
+
+#include <algorithm>  // std::max, std::min
+#include <atomic>
+#include <exception>  // std::exception_ptr
+
+namespace mono_slam {
+
+ThreadPool::ThreadPool(const int n_threads) : is_stopping_(false) {
+  workers_.reserve(std::max(n_threads, 1));
+  for (int i = 0; i < std::max(n_threads, 1); ++i)
+    workers_.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    is_stopping_ = true;
+  }
+  cond_var_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+void ThreadPool::workerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mut_);
+      cond_var_.wait(lock, [this] { return is_stopping_ || !tasks_.empty(); });
+      if (is_stopping_ && tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+void ThreadPool::parallelFor(const int begin, const int end,
+                             const std::function<void(int)>& fn) {
+  if (begin >= end) return;
+  // Indices are claimed dynamically so that uneven workloads balance out.
+  std::atomic<int> next{begin};
+  auto run = [&]() {
+    try {
+      for (int i = next++; i < end; i = next++) fn(i);
+    } catch (...) {
+      next = end;  // Others stop claiming indices.
+      throw;
+    }
+  };
+  //! The calling thread participates as well, hence one helper less.
+  const int n_helpers = std::min(size(), end - begin - 1);
+  std::vector<std::future<void>> helpers;
+  helpers.reserve(n_helpers);
+  for (int i = 0; i < n_helpers; ++i) helpers.push_back(enqueue(run));
+  // Wait for all helpers even if some throw, since they use next, run and fn
+  // living on this stack, then rethrow the first exception.
+  std::exception_ptr error;
+  try {
+    run();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (std::future<void>& helper : helpers) {
+    try {
+      helper.get();
+    } catch (...) {
+      if (!error) error = std::current_exception();
+    }
+  }
+  if (error) std::rethrow_exception(error);
+}
+
+}  // namespace mono_slam
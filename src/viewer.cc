@@ -67,7 +67,7 @@ void Viewer::updateOnce() {
   if (tracker_->state_ != State::GOOD) return;
   last_frame_ = tracker_->last_frame_;
   curr_frame_ = tracker_->curr_frame_;
-  points_ = map_->getAllMapPoints();
+  map_snapshot_ = map_->getSnapshot();
   LOG(INFO) << "Viewer is updating ...";
   // Invoke OpenCV drawer.
   // TODO(bayes) Spawn a new thread for opencv drawing.
@@ -102,11 +102,11 @@ void Viewer::drawingLoop() {
       // Only perform drawing when the tracking is good.
       update_cond_var_.wait(lock,
                             [this] { return tracker_->state_ == State::GOOD; });
-      // Get frames and map points by copy making viewer thread completely
-      // independent of others.
+      // Get frames by copy and the map by snapshot making viewer thread
+      // completely independent of others.
       last_frame_ = tracker_->last_frame_;
       curr_frame_ = tracker_->curr_frame_;
-      points_ = map_->getAllMapPoints();
+      map_snapshot_ = map_->getSnapshot();
     }
     LOG(INFO) << "Viewer is updating ...";
     // Invoke OpenCV drawer.
@@ -167,22 +167,22 @@ void Viewer::drawTrajectory() {
 }
 
 void Viewer::drawMapPoints() {
-  for (const MapPoint::Ptr& point : points_) {
-    if (!point) continue;
+  map_snapshot_->mapPoints().forEach([this](const MapPoint::Ptr& point) {
+    if (!point) return;
     // If the map point is first observed by curr_frame_, it's the new map point
     // and will be rendered with a different color.
     if (point->ref_frame_id_ == curr_frame_->id_)
       pcl_viewer_->insertNewMapPoint(point->pos());
     else
       pcl_viewer_->insertMapPoint(point->pos());
-  }
+  });
 }
 
 void Viewer::reset() {
   lock_g lock(mut_);
   last_frame_.reset();
   curr_frame_.reset();
-  points_.clear();
+  map_snapshot_.reset();
   pcl_viewer_->reset();
   // pcl_viewer_.reset(new viewer_utils::PclViewer(viewer_pose_));
 }